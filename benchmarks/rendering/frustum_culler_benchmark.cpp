@@ -0,0 +1,36 @@
+#include "rendering/frustum_culler.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace chove::rendering {
+namespace {
+
+void BM_FrustumCull(benchmark::State &state) {
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<float> position(-200.0F, 200.0F);
+  std::uniform_real_distribution<float> size(0.01F, 10.0F);
+  FrustumCuller culler;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    const glm::vec3 min(position(generator), position(generator), position(generator));
+    culler.Add({min, min + glm::vec3(size(generator), size(generator), size(generator))});
+  }
+  const Frustum frustum =
+      Frustum::FromMatrix(glm::perspective(glm::radians(60.0F), 16.0F / 9.0F, 0.1F, 150.0F));
+
+  std::vector<uint32_t> visible;
+  for (auto _ : state) {
+    culler.Cull(frustum, visible);
+    benchmark::DoNotOptimize(visible.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FrustumCull)->Arg(1'000)->Arg(10'000)->Arg(100'000);
+
+}  // namespace
+}  // namespace chove::rendering
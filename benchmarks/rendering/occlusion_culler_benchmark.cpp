@@ -0,0 +1,57 @@
+#include "rendering/occlusion_culler.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace chove::rendering {
+namespace {
+
+// Matches the renderer's default occluder triangle budget and depth buffer size.
+constexpr int kTriangleBudget = 16384;
+constexpr int kWidth = 256;
+constexpr int kHeight = 128;
+constexpr int kBoxCount = 10'000;
+
+// Rasterizes a budget's worth of occluder triangles and tests boxes against them, with the thread count as argument.
+void BM_OcclusionCull(benchmark::State &state) {
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<float> lateral(-30.0F, 30.0F);
+  std::uniform_real_distribution<float> depth(-60.0F, -2.0F);
+  std::uniform_real_distribution<float> size(0.5F, 8.0F);
+  OccluderProxy occluders;
+  for (uint32_t i = 0; i < kTriangleBudget; i++) {
+    const glm::vec3 corner(lateral(generator), lateral(generator), depth(generator));
+    occluders.positions.push_back(corner);
+    occluders.positions.push_back(corner + glm::vec3(size(generator), 0.0F, 0.0F));
+    occluders.positions.push_back(corner + glm::vec3(0.0F, size(generator), 0.0F));
+    occluders.indices.insert(occluders.indices.end(), {3 * i, 3 * i + 1, 3 * i + 2});
+  }
+  std::vector<Mesh::BoundingBox> boxes;
+  for (int i = 0; i < kBoxCount; i++) {
+    const glm::vec3 min(lateral(generator), lateral(generator), depth(generator));
+    boxes.push_back({min, min + glm::vec3(size(generator) / 4.0F)});
+  }
+  const glm::mat4 view_projection = glm::perspective(glm::radians(60.0F), 2.0F, 0.1F, 100.0F);
+
+  OcclusionCuller culler(kWidth, kHeight, static_cast<int>(state.range(0)));
+  for (auto _ : state) {
+    culler.Begin(view_projection);
+    culler.AddOccluder(glm::mat4(1.0F), occluders.positions, occluders.indices);
+    culler.Rasterize();
+    int visible_count = 0;
+    for (const Mesh::BoundingBox &box : boxes) {
+      visible_count += culler.IsVisible(box) ? 1 : 0;
+    }
+    benchmark::DoNotOptimize(visible_count);
+  }
+  state.counters["triangles"] = static_cast<double>(culler.triangle_count());
+}
+BENCHMARK(BM_OcclusionCull)->Arg(1)->Arg(4)->UseRealTime();
+
+}  // namespace
+}  // namespace chove::rendering
@@ -3,6 +3,7 @@
 
 #include "objects/scene.h"
 #include "rendering/renderer.h"
+#include "rendering/renderer_settings.h"
 #include "windowing/window.h"
 
 #include <absl/container/flat_hash_map.h>
@@ -16,7 +17,7 @@ using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
 
 class Application {
  public:
-  explicit Application(windowing::RendererType renderer_type);
+  explicit Application(windowing::RendererType renderer_type, rendering::RendererSettings renderer_settings = {});
   Application(const Application &) = delete;
   Application &operator=(const Application &) = delete;
   Application(Application &&) noexcept = delete;
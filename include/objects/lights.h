@@ -1,6 +1,8 @@
 #ifndef CHOVENGINE_INCLUDE_OBJECTS_LIGHTS_H_
 #define CHOVENGINE_INCLUDE_OBJECTS_LIGHTS_H_
 
+#include <cstdint>
+
 #include <glm/glm.hpp>
 
 namespace chove::objects {
@@ -21,6 +23,9 @@ struct PointLight {
   alignas(16) glm::vec3 color;
   float ambient;
   alignas(16) glm::vec3 positionEyeSpace;
+  // Cube of the renderer's point shadow map array holding this light's shadows, set by the renderer. -1 for lights
+  // drawn without shadows.
+  int32_t shadow_layer = -1;
 };
 
 struct SpotLight {
@@ -0,0 +1,52 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_FRUSTUM_CULLER_H_
+#define CHOVENGINE_INCLUDE_RENDERING_FRUSTUM_CULLER_H_
+
+#include "rendering/mesh.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace chove::rendering {
+
+struct Frustum {
+  // Plane equations with normals pointing inwards, not normalized.
+  std::array<glm::vec4, 6> planes;
+
+  // Extracts the planes from a projection times view matrix. The near plane assumes OpenGL's -w to w clip space depth,
+  // for zero to one depth projections it is only looser than needed.
+  static Frustum FromMatrix(const glm::mat4 &view_projection);
+
+  // Whether a world space sphere is at least partially inside the frustum.
+  [[nodiscard]] bool IntersectsSphere(const glm::vec3 &center, float radius) const;
+};
+
+// Culls world space bounding boxes against a frustum. The boxes are kept as centers and extents in structure of arrays
+// form and tested eight at a time with AVX, four at a time with SSE, or one at a time without either.
+class FrustumCuller {
+ public:
+  // Boxes are identified by the order they are added in, starting at 0 after each Clear.
+  void Clear();
+  void Add(const Mesh::BoundingBox &world_bounds);
+  [[nodiscard]] size_t size() const { return count_; }
+
+  // Replaces visible with the indices of the boxes at least partially inside the frustum, in increasing order.
+  void Cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+
+ private:
+  // Padded to a whole number of SIMD lanes, the padding lanes are never reported as visible.
+  std::vector<float> center_x_;
+  std::vector<float> center_y_;
+  std::vector<float> center_z_;
+  std::vector<float> extent_x_;
+  std::vector<float> extent_y_;
+  std::vector<float> extent_z_;
+  size_t count_ = 0;
+};
+
+}  // namespace chove::rendering
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_FRUSTUM_CULLER_H_
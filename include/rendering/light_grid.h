@@ -0,0 +1,99 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_LIGHT_GRID_H_
+#define CHOVENGINE_INCLUDE_RENDERING_LIGHT_GRID_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace chove::rendering {
+
+// Splits the view frustum into clusters, a grid of screen tiles cut into slices growing exponentially with depth, and
+// lists the point and spot lights reaching each cluster, so that shading only visits the lights of its own cluster.
+//
+// Clusters are kept as view space boxes, and the bounding spheres of the boxes, in structure of arrays form. Each light
+// is tested against the clusters of the depth slices its range spans, eight at a time with AVX, four at a time with
+// SSE, or one at a time without either: the sphere of its range against the boxes and, for spot lights, its cone
+// against the spheres.
+class LightGrid {
+ public:
+  static constexpr int kClustersX = 16;
+  static constexpr int kClustersY = 9;
+  static constexpr int kClustersZ = 24;
+  static constexpr int kClusterCount = kClustersX * kClustersY * kClustersZ;
+  // Set in the light indices of spot lights, which are numbered separately from point lights.
+  static constexpr uint32_t kSpotLightBit = 1U << 31;
+
+  // Lights of a cluster, as a range of light_indices().
+  struct Range {
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  LightGrid();
+
+  // Fits the clusters to a perspective projection with the given depth range, seen on a screen of width by height
+  // pixels, which must both be positive. The cluster bounds are only computed again when any of them changed.
+  void SetView(const glm::mat4 &projection, float near_plane, float far_plane, int width, int height);
+  // Positions and directions are in view space. Lights are numbered by type in the order they are added, starting at 0
+  // after each Assign.
+  void AddPointLight(const glm::vec3 &position, float range);
+  // outer_angle is the angle between the axis of the cone and its side, in radians.
+  void AddSpotLight(const glm::vec3 &position, const glm::vec3 &direction, float outer_angle, float range);
+  // Lists the lights added since the last Assign in the clusters they reach, then forgets them.
+  void Assign();
+
+  [[nodiscard]] std::span<const Range> ranges() const { return ranges_; }
+  // Indices of the lights of every cluster, the lights of one cluster next to each other in the order they were added.
+  [[nodiscard]] std::span<const uint32_t> light_indices() const { return light_indices_; }
+  // Size of a cluster on screen in pixels, then the scale and bias turning the logarithm of a view depth into a depth
+  // slice, matching clusterParams in the shaders.
+  [[nodiscard]] const glm::vec4 &params() const { return params_; }
+
+ private:
+  struct Light {
+    glm::vec3 position;
+    float range;
+    glm::vec3 direction;
+    // Cosine and sine of the cone's angle, -1 and 0 for point lights, whose cone covers every direction.
+    float cos_angle;
+    float sin_angle;
+    uint32_t index;
+  };
+
+  glm::mat4 projection_{};
+  float near_plane_ = 0.0F;
+  float far_plane_ = 0.0F;
+  int width_ = 0;
+  int height_ = 0;
+  glm::vec4 params_{};
+
+  std::vector<float> min_x_;
+  std::vector<float> min_y_;
+  std::vector<float> min_z_;
+  std::vector<float> max_x_;
+  std::vector<float> max_y_;
+  std::vector<float> max_z_;
+  std::vector<float> center_x_;
+  std::vector<float> center_y_;
+  std::vector<float> center_z_;
+  std::vector<float> radius_;
+
+  std::vector<Light> lights_;
+  uint32_t point_light_count_ = 0;
+  uint32_t spot_light_count_ = 0;
+  // Cluster and light index of every light reaching a cluster, gathered before being sorted by cluster.
+  std::vector<std::pair<uint32_t, uint32_t>> assignments_;
+  std::vector<Range> ranges_;
+  std::vector<uint32_t> light_indices_;
+
+  // Depth slice a view depth falls in, clamped to the grid.
+  [[nodiscard]] int Slice(float depth) const;
+};
+
+}  // namespace chove::rendering
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_LIGHT_GRID_H_
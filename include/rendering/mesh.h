@@ -21,12 +21,15 @@ struct Mesh {
     glm::vec3 max;
 
     [[nodiscard]] glm::vec3 center() const { return (min + max) / 2.0F; }
+    [[nodiscard]] BoundingBox Transformed(const glm::mat4 &matrix) const;
   };
   std::vector<Vertex> vertices;
   std::vector<glm::vec3> color;
   std::vector<uint32_t> indices;
   Material material;
   BoundingBox bounding_box;
+  // Texture coordinate units per unit of object space, used to estimate how many texels an object needs on screen.
+  float texcoord_density;
 
   static std::vector<Mesh> ImportFromObj(const std::filesystem::path& path);
 };
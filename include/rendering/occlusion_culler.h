@@ -0,0 +1,108 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OCCLUSION_CULLER_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OCCLUSION_CULLER_H_
+
+#include "rendering/mesh.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace chove::rendering {
+
+// Low-poly stand-in for the mesh of an object when it occludes others, attached to the object's entity. It has to lie
+// inside the mesh, since it is rasterized in its place.
+struct OccluderProxy {
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// Hides boxes behind a few large occluders by rasterizing the occluders into a coarse depth buffer on the CPU and
+// testing the boxes against a hierarchical-Z pyramid of it, entirely without the GPU.
+//
+// Rows of the depth buffer are split into one band per thread and every thread rasterizes all triangles into its own
+// band, eight pixels at a time with AVX, four with SSE, or one without either. A pixel covered at its center keeps the
+// farthest depth the triangle takes inside the pixel, and every pyramid level keeps the farthest depth of the four
+// texels below it, so a box behind every texel it covers is hidden. The only error is the one of center sampling,
+// which can hide a box peeking out less than a pixel past an occluder's silhouette.
+class OcclusionCuller {
+ public:
+  // The width is rounded up to a whole number of SIMD lanes.
+  OcclusionCuller(int width, int height, int thread_count);
+  OcclusionCuller(const OcclusionCuller &) = delete;
+  OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+  OcclusionCuller(OcclusionCuller &&) noexcept = delete;
+  OcclusionCuller &operator=(OcclusionCuller &&) noexcept = delete;
+  ~OcclusionCuller() = default;
+
+  // Forgets the occluders of the last frame and starts one seen through view_projection, which is expected to map depth
+  // to OpenGL's -w to w clip space range.
+  void Begin(const glm::mat4 &view_projection);
+  // Queues the triangles of an occluder, positions in object space. Triangles are clipped against the near plane and
+  // both of their faces occlude.
+  void AddOccluder(const glm::mat4 &model, std::span<const glm::vec3> positions, std::span<const uint32_t> indices);
+  void AddOccluder(const glm::mat4 &model, std::span<const Mesh::Vertex> vertices, std::span<const uint32_t> indices);
+  // Rasterizes the queued occluders and builds the depth pyramid the tests read.
+  void Rasterize();
+
+  // Whether a world space box may be visible, false only when it is hidden behind the rasterized occluders. Boxes
+  // crossing the near plane or outside the screen are always visible, frustum culling takes care of the latter.
+  [[nodiscard]] bool IsVisible(const Mesh::BoundingBox &world_bounds) const;
+
+  [[nodiscard]] size_t triangle_count() const { return triangles_.size(); }
+
+ private:
+  // A triangle in pixel coordinates set up for rasterization: three edge functions that are non-negative inside and the
+  // plane of its depth, already offset towards the far side of a pixel.
+  struct Triangle {
+    std::array<glm::vec3, 3> edges;
+    glm::vec3 depth_plane;
+    float max_depth;
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+  };
+  // One level of the pyramid, level 0 being the depth buffer itself.
+  struct DepthLevel {
+    int width;
+    int height;
+    std::vector<float> depths;
+  };
+
+  int width_;
+  int height_;
+  glm::mat4 view_projection_{};
+  std::vector<glm::vec4> clip_positions_;
+  std::vector<Triangle> triangles_;
+  std::vector<DepthLevel> levels_;
+
+  void AddTriangles(std::span<const uint32_t> indices);
+  void AddClippedTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+  void AddScreenTriangle(std::array<glm::vec3, 3> vertices);
+  // Rasterizes every triangle into the rows of one band.
+  void RasterizeBand(int band);
+  void BuildPyramid();
+  void WorkerLoop(const std::stop_token &stop_token, int band);
+
+  // Bands past the first are rasterized by the workers, each generation of work covers every band once.
+  int band_count_;
+  std::mutex mutex_;
+  std::condition_variable_any work_ready_;
+  std::condition_variable work_done_;
+  uint64_t generation_ = 0;
+  int pending_bands_ = 0;
+  // Declared last, so that the workers stop before the state they wait on goes away.
+  std::vector<std::jthread> workers_;
+};
+
+}  // namespace chove::rendering
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OCCLUSION_CULLER_H_
@@ -0,0 +1,70 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_BAKED_TEXTURE_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_BAKED_TEXTURE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace chove::rendering::opengl {
+
+// Read-only mapping of a whole file into memory.
+class MappedFile {
+ public:
+  static std::optional<MappedFile> Open(const std::filesystem::path &path);
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  ~MappedFile();
+
+  [[nodiscard]] std::span<const uint8_t> data() const { return {data_, size_}; }
+
+ private:
+  MappedFile(const uint8_t *data, size_t size, void *native_handle);
+  void Close();
+
+  const uint8_t *data_;
+  size_t size_;
+  // File mapping object on Windows, unused elsewhere.
+  void *native_handle_;
+};
+
+// Texture baked next to its source image: a small header followed by the full, vertically flipped mip chain, either as
+// sRGB RGBA8 or block compressed by the driver. Loading a baked texture maps the file and the mip levels point straight
+// into the mapping, so nothing is decoded or copied before the upload.
+class BakedTexture {
+ public:
+  struct MipLevel {
+    int width;
+    int height;
+    std::span<const uint8_t> data;
+  };
+
+  // Maps the baked file of the image at source_path, baking it first if it is missing, older than the source or baked
+  // with another format.
+  static std::optional<BakedTexture> Load(const std::filesystem::path &source_path, bool compress);
+
+  [[nodiscard]] GLenum internal_format() const { return internal_format_; }
+  [[nodiscard]] bool compressed() const { return internal_format_ != GL_SRGB; }
+  [[nodiscard]] const std::vector<MipLevel> &mip_levels() const { return mip_levels_; }
+
+ private:
+  BakedTexture(MappedFile file, GLenum internal_format, std::vector<MipLevel> mip_levels);
+
+  static bool Bake(const std::filesystem::path &source_path, const std::filesystem::path &baked_path,
+                   GLenum internal_format);
+
+  MappedFile file_;
+  GLenum internal_format_;
+  std::vector<MipLevel> mip_levels_;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_BAKED_TEXTURE_H_
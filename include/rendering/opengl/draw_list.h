@@ -0,0 +1,57 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_DRAW_LIST_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_DRAW_LIST_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+namespace chove::rendering::opengl {
+
+enum class DrawPass : uint8_t {
+  kShadow = 0,
+  kMain = 1,
+};
+
+// Draws of a frame ordered by a 64-bit key, so that consecutive draws share as much GL state as possible. From the
+// most significant bit down the key holds the pass, whether the draw is transparent and then, for opaque draws, the
+// shader variant, the material and the mesh, which puts draws of one mesh next to each other for instancing.
+// Transparent draws have to be blended back to front, so their depth comes right after the transparency bit and only
+// ties are broken by state.
+class DrawList {
+ public:
+  struct Command {
+    uint64_t key;
+    entt::entity entity;
+  };
+
+  static uint64_t OpaqueKey(DrawPass pass, uint32_t shader_variant, uint32_t material, uint32_t mesh);
+  // distance is any non-negative value growing with the distance to the camera, farther draws come first.
+  static uint64_t TransparentKey(DrawPass pass, float distance, uint32_t shader_variant, uint32_t material);
+
+  void Clear() { commands_.clear(); }
+  void Add(uint64_t key, entt::entity entity) { commands_.push_back(Command{key, entity}); }
+  // Commands added in key order, after every command added before, keep the list sorted without a Sort.
+  void Append(std::span<const Command> commands) {
+    commands_.insert(commands_.end(), commands.begin(), commands.end());
+  }
+  // Radix sort on the keys, stable so that draws with equal keys keep the order they were added in.
+  void Sort();
+  // Stable insertion sort, close to linear for commands that are almost in key order already, such as draws re-keyed
+  // with depths that changed little since the last frame.
+  static void SortNearlySorted(std::span<Command> commands);
+
+  // Commands of one pass, in key order. Only valid while the list is in key order.
+  [[nodiscard]] std::span<const Command> Pass(DrawPass pass) const;
+  [[nodiscard]] size_t size() const { return commands_.size(); }
+
+ private:
+  std::vector<Command> commands_;
+  std::vector<Command> scratch_;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_DRAW_LIST_H_
@@ -0,0 +1,72 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_FRAME_RING_BUFFER_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_FRAME_RING_BUFFER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <span>
+
+#include <GL/glew.h>
+
+namespace chove::rendering::opengl {
+
+// One persistently mapped buffer holding everything the CPU writes anew every frame, such as per-draw data, lights and
+// indirect draw commands. It is split in one region per frame in flight, and a region is only written again once the
+// fence placed after the frame that last used it has signalled, so writing never stalls on draws still reading the
+// previous contents.
+class FrameRingBuffer {
+ public:
+  struct Allocation {
+    GLintptr offset;
+    GLsizeiptr size;
+    std::byte *data;
+  };
+
+  FrameRingBuffer();
+  FrameRingBuffer(const FrameRingBuffer &) = delete;
+  FrameRingBuffer &operator=(const FrameRingBuffer &) = delete;
+  FrameRingBuffer(FrameRingBuffer &&) noexcept = delete;
+  FrameRingBuffer &operator=(FrameRingBuffer &&) noexcept = delete;
+  ~FrameRingBuffer();
+
+  // Sizes every region to hold allocation_count allocations adding up to size bytes, waiting for the GPU to finish with
+  // the old storage.
+  void Reserve(size_t size, size_t allocation_count);
+  // Moves on to the next region, waiting if the GPU still reads it.
+  void BeginFrame();
+  // Fences the allocations made since BeginFrame.
+  void EndFrame();
+
+  // Allocations are aligned for use as uniform and shader storage buffer ranges and live until the next BeginFrame
+  // that reuses their region.
+  Allocation Allocate(size_t size);
+  template<typename T>
+  Allocation Write(std::span<const T> data) {
+    const Allocation allocation = Allocate(data.size_bytes());
+    std::memcpy(allocation.data, data.data(), data.size_bytes());
+    return allocation;
+  }
+
+  // For indexed targets such as uniform or shader storage buffers. Empty allocations are not bound.
+  void BindRange(GLenum target, GLuint binding, const Allocation &allocation) const;
+
+  [[nodiscard]] GLuint buffer() const { return buffer_; }
+
+ private:
+  static constexpr int kFramesInFlight = 3;
+
+  GLuint buffer_ = 0;
+  std::byte *mapped_ = nullptr;
+  size_t alignment_;
+  size_t region_size_ = 0;
+  int region_ = 0;
+  size_t cursor_ = 0;
+  std::array<GLsync, kFramesInFlight> fences_{};
+
+  [[nodiscard]] size_t Aligned(size_t size) const { return (size + alignment_ - 1) / alignment_ * alignment_; }
+  void WaitForRegion(int region);
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_FRAME_RING_BUFFER_H_
@@ -0,0 +1,78 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_GEOMETRY_BUFFER_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_GEOMETRY_BUFFER_H_
+
+#include "rendering/mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <absl/container/flat_hash_map.h>
+#include <GL/glew.h>
+
+namespace chove::rendering::opengl {
+
+// Layout glMultiDrawElementsIndirect reads its commands in.
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+// The vertices and indices of every mesh in the scene, suballocated from one vertex buffer and one index buffer behind
+// a single vertex array, so that draws of different meshes need no rebinding and can be merged into multi-draws.
+//
+// The vertex array also feeds the draw index attribute at location 4, an instanced attribute counting up from zero.
+// Indirect draws set their base instance to the index of their per-draw data, which the attribute hands to the
+// shaders, since gl_DrawID and gl_BaseInstance are not available before GL 4.6.
+//
+// A second vertex array over the same buffers only fetches positions and the draw index, for depth-only passes.
+class GeometryBuffer {
+ public:
+  struct Range {
+    GLint base_vertex;
+    GLuint first_index;
+    GLsizei index_count;
+    // Counts the distinct meshes, objects drawing the same mesh share it and can be drawn instanced.
+    uint32_t mesh;
+
+    // Byte offset of the first index, for glDrawElementsBaseVertex.
+    [[nodiscard]] const void *index_offset() const {
+      return reinterpret_cast<const void *>(static_cast<size_t>(first_index) * sizeof(GLuint));
+    }
+  };
+
+  GeometryBuffer();
+  GeometryBuffer(const GeometryBuffer &) = delete;
+  GeometryBuffer &operator=(const GeometryBuffer &) = delete;
+  GeometryBuffer(GeometryBuffer &&) noexcept = delete;
+  GeometryBuffer &operator=(GeometryBuffer &&) noexcept = delete;
+  ~GeometryBuffer();
+
+  // Stages a mesh for the next Upload. Meshes shared by several objects are stored once.
+  Range Add(const Mesh &mesh);
+  // Replaces the buffer contents with the staged meshes and sizes the draw index attribute for max_draws draws.
+  void Upload(size_t max_draws);
+  // Forgets every mesh, the buffers keep their contents until the next Upload.
+  void Clear();
+
+  [[nodiscard]] GLuint vertex_array() const { return vertex_array_; }
+  [[nodiscard]] GLuint position_vertex_array() const { return position_vertex_array_; }
+
+ private:
+  GLuint vertex_array_ = 0;
+  GLuint position_vertex_array_ = 0;
+  GLuint vertex_buffer_ = 0;
+  GLuint index_buffer_ = 0;
+  GLuint draw_index_buffer_ = 0;
+
+  std::vector<Mesh::Vertex> staged_vertices_;
+  std::vector<GLuint> staged_indices_;
+  absl::flat_hash_map<const Mesh *, Range> ranges_;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_GEOMETRY_BUFFER_H_
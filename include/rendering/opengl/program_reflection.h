@@ -0,0 +1,33 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_PROGRAM_REFLECTION_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_PROGRAM_REFLECTION_H_
+
+#include <string>
+#include <string_view>
+
+#include <absl/container/flat_hash_map.h>
+#include <GL/glew.h>
+
+namespace chove::rendering::opengl {
+
+// Active uniforms of a linked program, queried once. Every sampler, including every element of sampler arrays, gets a
+// texture unit of its own that is stored in the program, so drawing only has to bind textures to those units.
+class ProgramReflection {
+ public:
+  ProgramReflection() = default;
+  explicit ProgramReflection(GLuint program);
+
+  // Both return -1 for names the program does not use. Array elements are looked up as "name[index]".
+  [[nodiscard]] GLint Location(std::string_view name) const;
+  [[nodiscard]] int SamplerUnit(std::string_view name) const;
+  // Units are assigned from 0 without gaps, so this is one past the highest unit.
+  [[nodiscard]] int sampler_unit_count() const { return sampler_unit_count_; }
+
+ private:
+  absl::flat_hash_map<std::string, GLint> locations_;
+  absl::flat_hash_map<std::string, int> sampler_units_;
+  int sampler_unit_count_ = 0;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_PROGRAM_REFLECTION_H_
@@ -1,9 +1,11 @@
 #ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_RENDER_OBJECT_H_
 #define CHOVENGINE_INCLUDE_RENDERING_OPENGL_RENDER_OBJECT_H_
 
-#include "rendering/opengl/uniform.h"
+#include "rendering/opengl/geometry_buffer.h"
 #include "rendering/opengl/texture.h"
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #include <absl/container/flat_hash_map.h>
@@ -11,6 +13,16 @@
 #include <GL/glew.h>
 
 namespace chove::rendering::opengl {
+
+// A material texture that lives in a layer of a texture array shared with other materials.
+struct TextureLayer {
+  std::string name;
+  GLuint texture_array;
+  int layer;
+  // Index of the texture in the material, used to find its layer uniform.
+  int slot;
+};
+
 struct RenderObject {
   RenderObject() = default;
   RenderObject(RenderObject &) = delete;
@@ -18,19 +30,33 @@ struct RenderObject {
   RenderObject(RenderObject &&other) noexcept;
   RenderObject &operator=(RenderObject &&other) noexcept;
 
-  Uniform<glm::mat4> model{};
-  Uniform<glm::mat4> shadow_model{};
-  Uniform<glm::mat3> normal_matrix{};
   size_t object_index{};
+  // Index into the renderer's shader variants.
   size_t shader_index{};
-  GLuint vao{};
-  GLuint vbo{};
-  GLuint ebo{};
+  // Where the object's mesh lives in the renderer's geometry buffer.
+  GeometryBuffer::Range geometry{};
+  // Objects sampling the same textures share a material index, which groups them in the draw order.
+  uint32_t material_index{};
+  // Index of the object's material parameters in the renderer's material buffer, shared by objects of one material.
+  uint32_t material_data_index{};
+  // Index of the object's bounds in the renderer's frustum culler, assigned every frame.
+  uint32_t cull_index{};
+  // Transform the object was set up with. Objects are static shadow casters until their transform first differs.
+  glm::mat4 static_model{};
+  bool dynamic_caster{};
+  // Blended objects are drawn after the opaque ones, back to front.
+  bool transparent{};
   std::vector<Texture> textures{};
-  UniformBuffer material_data{};
-  float dist{};
+  std::vector<TextureLayer> texture_layers{};
+  // Sampler units of the textures and texture layers in the object's shader, -1 when the shader does not sample them.
+  std::vector<int> texture_units{};
+  std::vector<int> texture_layer_units{};
+  // Alpha texture sampled by the depth passes, the white pixel for objects without one.
+  GLuint shadow_alpha_texture{};
+  // Set once the object's shader has linked and its uniforms and blocks are set up.
+  bool shader_ready{};
 
-  ~RenderObject();
+  ~RenderObject() = default;
 };
 }
 
@@ -2,15 +2,36 @@
 #define CHOVENGINE_INCLUDE_RENDERING_OPENGL_RENDERER_H_
 
 #include "rendering/renderer.h"
+#include "rendering/renderer_settings.h"
 #include "objects/scene.h"
+#include "rendering/frustum_culler.h"
+#include "rendering/light_grid.h"
+#include "rendering/occlusion_culler.h"
+#include "rendering/opengl/draw_list.h"
+#include "rendering/opengl/frame_ring_buffer.h"
+#include "rendering/opengl/geometry_buffer.h"
 #include "rendering/opengl/pipeline.h"
+#include "rendering/opengl/program_reflection.h"
 #include "rendering/opengl/render_object.h"
+#include "rendering/opengl/shader_flags.h"
+#include "rendering/opengl/shadow_atlas.h"
+#include "rendering/opengl/shadow_scheduler.h"
 #include "rendering/opengl/texture_allocator.h"
+#include "rendering/opengl/texture_array_packer.h"
+#include "rendering/opengl/texture_streamer.h"
 #include "rendering/opengl/uniform.h"
 #include "windowing/window.h"
 
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/log/log.h>
 
 namespace chove::rendering::opengl {
@@ -22,29 +43,241 @@ class Renderer : public rendering::Renderer {
   Renderer &operator=(Renderer &&) noexcept = default;
   ~Renderer() override = default;
 
-  explicit Renderer(const windowing::Window *window);
+  explicit Renderer(const windowing::Window *window, RendererSettings settings = {});
 
   void Render() override;
   void SetupScene(objects::Scene &scene) override;
 
+  // GL state changes issued by the last frame, redundant binds that were skipped are not counted.
+  struct FrameStats {
+    int program_binds;
+    int texture_binds;
+    int vertex_array_binds;
+    // GL draw calls, a multi-draw counting once, the draws the indirect multi-draws carried and the instances drawn by
+    // all of them.
+    int draws;
+    int indirect_draws;
+    int instances;
+    // Shadow maps rendered this frame and the most frames any shadow map has gone without an update.
+    int shadow_map_updates;
+    int max_shadow_staleness;
+    // Fragments of opaque draws that passed the depth test of the main pass, and the ones the depth pre-pass kept from
+    // being shaded. Both come from occlusion queries of a few frames ago and are zero while those are still pending.
+    int64_t shaded_fragments;
+    int64_t prepass_saved_fragments;
+    // Objects inside the view frustum hidden by occlusion culling, and the occluder triangles it rasterized.
+    int occlusion_culled;
+    int occluder_triangles;
+    // Light indices across all clusters of the light grid, the point and spot lights shading looks at.
+    int clustered_lights;
+  };
+  [[nodiscard]] const FrameStats &frame_stats() const { return frame_stats_; }
+  // Frames since the shadow map of a light was last rendered.
+  [[nodiscard]] uint64_t ShadowStaleness(entt::entity light) const { return shadow_scheduler_.Staleness(light); }
+  // Uploads the parameters of a material edited since scene setup again before the next frame. Texture changes need a
+  // new scene setup.
+  void MarkMaterialDirty(const Material &material);
+
  private:
   const windowing::Window *window_;
   objects::Scene *scene_;
+  RendererSettings settings_;
+  uint64_t frame_index_ = 0;
+  FrameStats frame_stats_{};
 
   std::unique_ptr<TextureAllocator> texture_allocator_;
+  std::unique_ptr<TextureStreamer> texture_streamer_;
+  std::unique_ptr<TextureArrayPacker> texture_array_packer_;
   std::unique_ptr<ShaderAllocator> shader_allocator_;
 
-  UniformBuffer matrices_ubo_{};
-  UniformBuffer lights_{};
-
-  std::vector<Shader> shaders_;
+  struct ShaderVariant {
+    ShaderVariantKey key;
+    Shader shader;
+    // Filled in once the program has linked.
+    ProgramReflection reflection;
+    // Sampler unit of every shadow map, the point lights' cube maps first, then the shadow atlas. -1 for shadow maps
+    // the variant does not sample.
+    std::vector<int> shadow_map_units;
+    bool set_up;
+  };
+  // One shader per distinct variant in the scene, objects refer to them through RenderObject::shader_index.
+  std::vector<ShaderVariant> shader_variants_;
+  absl::flat_hash_map<ShaderVariantKey, size_t> shader_variant_indices_;
   std::unique_ptr<Shader> depth_map_shader_;
+  GLint depth_map_dissolve_location_ = -1;
+  GLint depth_map_light_space_matrix_location_ = -1;
+  int depth_map_alpha_unit_ = 0;
+  // Renders all six faces of a point light's cube map in one pass, routing triangles with gl_Layer.
+  std::unique_ptr<Shader> cube_depth_map_shader_;
+  GLint cube_depth_map_dissolve_location_ = -1;
+  GLint cube_depth_map_face_matrices_location_ = -1;
+  int cube_depth_map_alpha_unit_ = 0;
+  // Drawn in place of objects whose own shader variant has not finished compiling.
+  std::unique_ptr<Shader> fallback_shader_;
+  GLint fallback_model_location_ = -1;
+  GLint fallback_color_location_ = -1;
   std::unique_ptr<Texture> white_pixel_;
 
-  UniformBuffer light_space_matrices_{};
+  // One entry per directional light cascade and spot light, matching LightSpace in the shaders.
+  struct LightSpaceData {
+    glm::mat4 matrix;
+    // Where the light's tile is in the shadow atlas, see ShadowAtlas::UvRect. Zero for spot lights the atlas had no room
+    // for, which are not shadowed.
+    glm::vec4 atlas_rect;
+  };
+  // Contents of the light space storage block. Kept across frames, since lights whose shadow maps are not updated keep
+  // the matrices they were last rendered with.
+  glm::vec4 cascade_splits_{};
+  std::vector<LightSpaceData> light_spaces_;
+  // Shadow maps of the directional and spot lights, each light's tile is attached to its entity.
+  ShadowAtlas shadow_atlas_;
+  std::unique_ptr<Texture> shadow_atlas_texture_;
+  GLuint shadow_atlas_framebuffer_ = 0;
+  // Cube map array of the point lights with shadows, each of them renders into its cube through a cube map view of it
+  // attached to its entity. Null without point lights.
+  std::unique_ptr<Texture> point_shadow_maps_;
+
+  // Depth of the static shadow casters of a light, attached to the light's entity. The shadow map is restored from it
+  // every frame and only the dynamic casters are drawn on top, until the light moves or a static caster does.
+  struct StaticShadowCache {
+    Texture static_depth;
+    // Light space matrices the cache was rendered with, one per cube map face for point lights and per cascade for the
+    // directional light.
+    std::vector<glm::mat4> matrices;
+    bool valid;
+    // Whether the shadow map holds dynamic casters drawn over the static depth.
+    bool holds_dynamic_casters;
+  };
+  // One entry per caster drawn into a shadow view, matching ShadowInstance in the depth map shaders.
+  struct alignas(16) ShadowInstance {
+    glm::mat4 model;
+    // Cube map faces the caster is drawn into, ignored by the single view depth map.
+    int32_t face_mask;
+  };
+  // Casters of the shadow view being drawn, in shadow pass order. The depth pre-pass uploads its instances in the same
+  // layout.
+  std::vector<entt::entity> shadow_instances_;
+  // Set when a static caster moves, which invalidates every cache.
+  bool static_shadows_stale_ = true;
+  int dynamic_caster_count_ = 0;
+  ShadowScheduler shadow_scheduler_;
+
+  static constexpr int kMaxBoundTextureUnits = 32;
+  // Texture bound to each unit for the 2D, 2D array and cube map array targets, used to skip redundant binds.
+  std::array<std::array<GLuint, 3>, kMaxBoundTextureUnits> bound_textures_{};
+  GLuint bound_vertex_array_ = 0;
+  GLuint bound_program_ = 0;
+
+  // Parameters of a material and the layers of its packed textures, matching Material in the shaders.
+  struct MaterialData {
+    [[maybe_unused]] float shininess;
+    [[maybe_unused]] float opticalDensity;
+    [[maybe_unused]] float dissolve;
+    [[maybe_unused]] alignas(16) glm::vec3 diffuseColor;
+    [[maybe_unused]] alignas(16) glm::vec3 ambientColor;
+    [[maybe_unused]] alignas(16) glm::vec3 specularColor;
+    [[maybe_unused]] alignas(16) glm::vec3 transmissionFilterColor;
+    [[maybe_unused]] alignas(16) std::array<glm::ivec4, 2> textureLayers;
+  };
+  // Everything a draw of the main pass needs besides its textures, matching DrawData in the shaders. Aligned like the
+  // std430 struct, whose alignment is the one of its mat4 columns.
+  struct alignas(16) DrawData {
+    glm::mat4 model;
+    // Inverse transpose of the model view matrix, a mat4 since std430 pads mat3 columns to vec4 anyway.
+    glm::mat4 normal_matrix;
+    uint32_t material_index;
+  };
+
+  std::unique_ptr<GeometryBuffer> geometry_buffer_;
+  // Every distinct material of the scene, indexed by RenderObject::material_data_index. Uploaded whole at scene setup,
+  // then only the entries marked dirty are uploaded again.
+  std::vector<MaterialData> material_data_;
+  absl::flat_hash_map<const Material *, uint32_t> material_data_indices_;
+  std::vector<const Material *> dirty_materials_;
+  GLuint material_buffer_ = 0;
+  // Everything uploaded anew every frame: matrices, lights, light spaces, per-draw data and indirect commands.
+  std::unique_ptr<FrameRingBuffer> frame_buffer_;
+
+  // Samples passed by the depth pre-pass and by the opaque draws of the main pass. A pair is only read back right before
+  // it is issued again, kFragmentQueryFrames frames later, so that reading does not wait for the GPU.
+  static constexpr int kFragmentQueryFrames = 4;
+  struct FragmentQueries {
+    GLuint prepass;
+    GLuint shaded;
+    bool issued;
+  };
+  std::array<FragmentQueries, kFragmentQueryFrames> fragment_queries_{};
+  int fragment_query_index_ = 0;
+
+  DrawList draw_list_;
+  // Shadow draws of every object and main pass draws of every opaque one, in key order. Their keys only depend on state
+  // fixed at scene setup, so they are sorted once there and every frame copies out the draws it needs.
+  DrawList static_draws_;
+  // Main pass draws of every transparent object, kept from frame to frame. Re-keyed with new depths every frame they
+  // are still almost in order, which the insertion sort they get takes advantage of.
+  std::vector<DrawList::Command> transparent_draws_;
+  // Whether each box of the frustum culler passed the last camera cull.
+  std::vector<uint8_t> object_visible_;
+  FrustumCuller frustum_culler_;
+  // Entity and world bounds of each box in the frustum culler and the indices of the boxes that passed the last cull.
+  std::vector<entt::entity> culled_entities_;
+  std::vector<Mesh::BoundingBox> culled_bounds_;
+  std::vector<uint32_t> visible_objects_;
+  std::unique_ptr<OcclusionCuller> occlusion_culler_;
+  // Visible opaque objects that may occlude others, scored by how large they appear.
+  std::vector<std::pair<float, uint32_t>> occluder_candidates_;
+  // Point and spot lights reaching each cluster of the view frustum, assigned every frame.
+  LightGrid light_grid_;
+  // Shadow casters of the shadow view being rendered, as indices into the frustum culler and as a mask per object of
+  // the faces it is drawn into.
+  std::vector<uint32_t> shadow_casters_;
+  std::vector<uint8_t> shadow_caster_faces_;
+  Mesh::BoundingBox scene_bounds_{};
 
   void AttachMaterial(RenderObject &render_object, const Material &material);
-  void RenderDepthMap();
+  static void SetMaterialParameters(const Material &material, MaterialData &material_data);
+  void UploadDirtyMaterials();
+  // Moves on to the next fragment queries and fills the fragment counts of the frame stats from their last results.
+  void ReadFragmentQueries();
+  size_t GetShaderVariant(ShaderVariantKey key);
+  void FinishShaderSetup(RenderObject &render_info);
+  void DrawGeometry(const GeometryBuffer::Range &geometry, GLuint base_instance, GLsizei instance_count);
+  void DrawWithFallbackShader(const RenderObject &render_info, const objects::Transform &transform, const Mesh &mesh);
+  // Orders the draws whose keys do not change from frame to frame, once the scene is set up.
+  void SortStaticDraws();
+  void BuildDrawList();
+  // Removes the objects hidden behind the largest visible ones from visible_objects_.
+  void CullOccludedObjects(const glm::mat4 &view_projection);
+  // Draws the shadow casters inside the culling frustum, which may be tighter than the one of the light space matrix.
+  void RenderDepthMap(const glm::mat4 &light_space_matrix, const glm::mat4 &culling_matrix, bool dynamic_casters);
+  void RenderCubeDepthMap(
+      const std::array<glm::mat4, 6> &face_matrices,
+      const std::array<glm::mat4, 6> &culling_matrices,
+      bool dynamic_casters
+  );
+  // Draws the casters with faces in shadow_caster_faces_ with the bound depth map program, one instanced draw per mesh.
+  void DrawShadowCasters(bool dynamic_casters, GLint dissolve_location, int alpha_unit);
+  // Picks the shadow maps to render this frame within the face budget.
+  void ScheduleShadowUpdates();
+  // Frames since each shadowed light was last rendered, the frame stats only keep the stalest one.
+  [[nodiscard]] std::string ShadowStalenessReport() const;
+  // Gives a light a tile in the shadow atlas and a static shadow cache of the same size.
+  void AddShadowAtlasTile(entt::entity light, int preferred_size);
+  // Fills a region of the bound shadow map, the whole map for cube maps: restores or re-renders the static casters
+  // through draw_casters(false), then draws the dynamic ones with draw_casters(true).
+  void UpdateShadowMap(
+      StaticShadowCache &cache,
+      const Texture &depth_map,
+      GLenum target,
+      const ShadowAtlas::Tile &region,
+      std::span<const glm::mat4> matrices,
+      const std::function<void(bool dynamic_casters)> &draw_casters
+  );
+  void StreamTextures();
+  void PackMaterialTextures();
+  void BindTexture(int unit, GLenum target, GLuint texture);
+  void BindVertexArray(GLuint vertex_array);
+  void UseProgram(GLuint program);
 };
 } // namespace chove::rendering::opengl
 
@@ -4,6 +4,9 @@
 #include "rendering/opengl/shader_flags.h"
 
 #include <filesystem>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #include <GL/glew.h>
 
@@ -13,7 +16,7 @@
 namespace chove::rendering::opengl {
 class ShaderAllocator {
  public:
-  ShaderAllocator() = default;
+  explicit ShaderAllocator(std::filesystem::path binary_cache_directory = {});
   ~ShaderAllocator();
 
   ShaderAllocator(const ShaderAllocator &) = delete;
@@ -35,30 +38,47 @@ class ShaderAllocator {
 
   void DeallocateShader(GLuint shader);
 
+  // Programs are compiled and linked without waiting for the driver, so they cannot be used before IsReady returns
+  // true. With GL_KHR_parallel_shader_compile the query never blocks, otherwise it waits for the program.
+  [[nodiscard]] bool IsReady(GLuint program);
+  void WaitUntilReady(GLuint program);
+
  private:
   void InvalidateCache();
 
+  struct StageInfo {
+    GLenum type;
+    std::filesystem::path path;
+    std::vector<ShaderFlag> flags;
+  };
+
   struct ShaderInfo {
-    std::filesystem::path vertex_shader_path;
-    std::string vertex_shader_flags;
-    std::filesystem::path fragment_shader_path;
-    std::string fragment_shader_flags;
+    // Stage type, source path and variant key bits of every stage.
+    std::vector<std::tuple<GLenum, std::filesystem::path, uint64_t>> stages;
 
     // for hash map equality
-    friend bool operator==(const ShaderInfo &lhs, const ShaderInfo &rhs) {
-      return lhs.vertex_shader_path == rhs.vertex_shader_path &&
-          lhs.vertex_shader_flags == rhs.vertex_shader_flags &&
-          lhs.fragment_shader_path == rhs.fragment_shader_path &&
-          lhs.fragment_shader_flags == rhs.fragment_shader_flags;
-    }
+    friend bool operator==(const ShaderInfo &lhs, const ShaderInfo &rhs) { return lhs.stages == rhs.stages; }
 
     template<typename H>
     friend H AbslHashValue(H hash, const ShaderInfo &shader) {
-      return H::combine(std::move(hash), shader.vertex_shader_path, shader.vertex_shader_flags,
-                        shader.fragment_shader_path, shader.fragment_shader_flags);
+      return H::combine(std::move(hash), shader.stages);
     }
   };
 
+  // Program whose compile and link were submitted but whose status was not checked yet.
+  struct PendingProgram {
+    std::vector<GLuint> shaders;
+    std::filesystem::path binary_path;
+  };
+
+  GLuint AllocateProgram(const std::vector<StageInfo> &stages);
+  void FinishProgram(GLuint program, const PendingProgram &pending);
+
+  // Linked programs are saved here with glGetProgramBinary and loaded back on later runs, empty disables the cache.
+  std::filesystem::path binary_cache_directory_;
+  std::string driver_identifier_;
+  bool parallel_compile_ = false;
+  absl::node_hash_map<GLuint, PendingProgram> pending_programs_;
   absl::node_hash_map<ShaderInfo, GLuint> shader_creation_cache_;
   absl::node_hash_map<GLuint, uint32_t> shader_ref_counts;
 };
@@ -2,6 +2,10 @@
 #define CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADER_FLAGS_H_
 
 #include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <absl/log/check.h>
 
 enum class ShaderFlagTypes {
   kNoDiffuseTexture = 0,
@@ -14,6 +18,7 @@ enum class ShaderFlagTypes {
   kPointLightCount = 7,
   kDirectionalLightCount = 8,
   kSpotLightCount = 9,
+  kTextureArrays = 10,
 };
 
 struct ShaderFlag {
@@ -25,4 +30,78 @@ struct ShaderFlag {
   }
 };
 
+// All flags of a shader variant packed into one integer, so that variants can be compared and hashed cheaply and keys
+// for known variants can be built at compile time. Boolean flags take one bit each, light counts take kCountBits bits
+// each.
+class ShaderVariantKey {
+ public:
+  constexpr ShaderVariantKey() = default;
+  explicit ShaderVariantKey(const std::vector<ShaderFlag> &flags) {
+    for (const ShaderFlag &flag : flags) {
+      *this = With(flag.type, flag.value);
+    }
+  }
+
+  // Values that do not fit the field would silently alias another variant, so they are rejected.
+  [[nodiscard]] constexpr ShaderVariantKey With(ShaderFlagTypes type, int value = 1) const {
+    CHECK(value >= 0 && static_cast<uint64_t>(value) <= FieldMask(type))
+        << "Shader flag " << static_cast<int>(type) << " does not fit a variant key: " << value;
+    const uint64_t mask = FieldMask(type) << FieldOffset(type);
+    ShaderVariantKey key = *this;
+    key.bits_ = (bits_ & ~mask) | ((static_cast<uint64_t>(value) << FieldOffset(type)) & mask);
+    return key;
+  }
+
+  [[nodiscard]] constexpr int Get(ShaderFlagTypes type) const {
+    return static_cast<int>((bits_ >> FieldOffset(type)) & FieldMask(type));
+  }
+
+  [[nodiscard]] constexpr uint64_t bits() const { return bits_; }
+
+  // Light counts are always listed because the shaders test them in #if, and the directional light count sizes its
+  // array, boolean flags only when set.
+  [[nodiscard]] std::vector<ShaderFlag> ToFlags() const {
+    std::vector<ShaderFlag> flags;
+    for (int type = 0; type < kFlagTypeCount; ++type) {
+      const auto flag_type = static_cast<ShaderFlagTypes>(type);
+      if (IsCount(flag_type) || Get(flag_type) != 0) {
+        flags.push_back(ShaderFlag{flag_type, Get(flag_type)});
+      }
+    }
+    return flags;
+  }
+
+  friend constexpr bool operator==(const ShaderVariantKey &lhs, const ShaderVariantKey &rhs) = default;
+
+  template<typename H>
+  friend H AbslHashValue(H hash, const ShaderVariantKey &key) {
+    return H::combine(std::move(hash), key.bits_);
+  }
+
+ private:
+  static constexpr int kFlagTypeCount = static_cast<int>(ShaderFlagTypes::kTextureArrays) + 1;
+  static constexpr int kCountBits = 16;
+  static constexpr int kCountFieldsOffset = 16;
+  static_assert(kCountFieldsOffset + 3 * kCountBits <= 64, "Light counts must fit the key");
+
+  static constexpr bool IsCount(ShaderFlagTypes type) {
+    return type == ShaderFlagTypes::kPointLightCount || type == ShaderFlagTypes::kDirectionalLightCount ||
+        type == ShaderFlagTypes::kSpotLightCount;
+  }
+
+  static constexpr int FieldOffset(ShaderFlagTypes type) {
+    if (IsCount(type)) {
+      return kCountFieldsOffset +
+          kCountBits * (static_cast<int>(type) - static_cast<int>(ShaderFlagTypes::kPointLightCount));
+    }
+    return static_cast<int>(type);
+  }
+
+  static constexpr uint64_t FieldMask(ShaderFlagTypes type) {
+    return IsCount(type) ? (uint64_t{1} << kCountBits) - 1 : 1;
+  }
+
+  uint64_t bits_ = 0;
+};
+
 #endif //CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADER_FLAGS_H_
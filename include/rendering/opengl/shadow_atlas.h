@@ -0,0 +1,42 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADOW_ATLAS_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADOW_ATLAS_H_
+
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace chove::rendering::opengl {
+
+// Packs the shadow maps of several lights into square tiles of one depth texture. Tiles have power of two sizes and
+// are carved out of the atlas like a quadtree, a larger free tile is split in four when no tile of the requested size
+// is left.
+class ShadowAtlas {
+ public:
+  struct Tile {
+    int x;
+    int y;
+    int size;
+  };
+
+  // The atlas size must be a power of two.
+  explicit ShadowAtlas(int size);
+
+  // Reserves a tile of the given power of two size, or nothing when the atlas has no room left for it.
+  [[nodiscard]] std::optional<Tile> Allocate(int size);
+  // Frees every tile.
+  void Clear();
+
+  // Scale in xy and offset in zw mapping zero to one coordinates within the tile to coordinates within the atlas.
+  [[nodiscard]] glm::vec4 UvRect(const Tile &tile) const;
+  [[nodiscard]] int size() const { return size_; }
+
+ private:
+  int size_;
+  // Free tiles per quadtree level, level 0 being the whole atlas and every level halving the tile size.
+  std::vector<std::vector<Tile>> free_tiles_;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADOW_ATLAS_H_
@@ -0,0 +1,51 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADOW_SCHEDULER_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADOW_SCHEDULER_H_
+
+#include <cstdint>
+
+#include <absl/container/flat_hash_map.h>
+#include <entt/entt.hpp>
+
+namespace chove::rendering::opengl {
+
+// Decides which shadow maps are re-rendered each frame. Every light is requested with an importance, roughly how much
+// of the screen its shadows cover, and a cost in shadow map faces. Lights are then updated in order of importance
+// times the number of frames since their last update until the per-frame face budget runs out, the others keep the
+// shadow map of their last update.
+class ShadowScheduler {
+ public:
+  explicit ShadowScheduler(int face_budget) : face_budget_(face_budget) {}
+
+  void Request(entt::entity light, float importance, int face_cost);
+  // Picks the lights to update among those requested since the last call. The most urgent light and lights whose
+  // shadow map was never rendered are always updated, even when they cost more than the budget.
+  void Schedule();
+  [[nodiscard]] bool ShouldUpdate(entt::entity light) const;
+  // Frames since the shadow map of the light was last rendered.
+  [[nodiscard]] uint64_t Staleness(entt::entity light) const;
+  [[nodiscard]] uint64_t max_staleness() const { return max_staleness_; }
+  [[nodiscard]] int scheduled_count() const { return scheduled_count_; }
+
+  // Forgets all lights, for when the scene is set up again.
+  void Clear() { lights_.clear(); }
+
+ private:
+  struct LightState {
+    float importance;
+    int face_cost;
+    bool requested;
+    bool scheduled;
+    bool rendered;
+    uint64_t last_update_frame;
+  };
+
+  int face_budget_;
+  uint64_t frame_ = 0;
+  uint64_t max_staleness_ = 0;
+  int scheduled_count_ = 0;
+  absl::flat_hash_map<entt::entity, LightState> lights_;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_SHADOW_SCHEDULER_H_
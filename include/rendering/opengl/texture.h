@@ -13,6 +13,9 @@ class Texture {
   Texture(const std::filesystem::path &path, std::string name, TextureAllocator &allocator);
   Texture(int width, int height, std::string name, TextureAllocator &allocator);
   Texture(int cube_length, std::string name, TextureAllocator &allocator);
+  static Texture CubeDepthMapArray(int cube_length, int cube_count, std::string name, TextureAllocator &allocator);
+  // Shares the storage of one cube of a cube map array.
+  static Texture CubeDepthMapView(const Texture &cube_array, int cube, std::string name, TextureAllocator &allocator);
   Texture(const Texture &) = delete;
   Texture &operator=(const Texture &) = delete;
   Texture(Texture &&) noexcept;
@@ -24,6 +27,8 @@ class Texture {
   ~Texture();
 
  private:
+  Texture(GLuint texture, std::string name, TextureAllocator &allocator);
+
   GLuint texture_;
   std::string name_;
   TextureAllocator *allocator_;
@@ -1,14 +1,21 @@
 #ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTUREALLOCATOR_H_
 #define CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTUREALLOCATOR_H_
 
+#include "rendering/opengl/baked_texture.h"
+
+#include <cstdint>
 #include <filesystem>
+#include <span>
+#include <vector>
 #include <absl/container/flat_hash_map.h>
 #include <GL/glew.h>
 
 namespace chove::rendering::opengl {
 class TextureAllocator {
  public:
-  TextureAllocator();
+  // Textures are loaded from baked files next to their source images, compress_textures selects block compressed
+  // baked files.
+  TextureAllocator(size_t memory_budget, bool compress_textures);
   ~TextureAllocator();
 
   TextureAllocator(const TextureAllocator &) = delete;
@@ -19,14 +26,59 @@ class TextureAllocator {
   GLuint AllocateTexture(const std::filesystem::path &path);
   GLuint AllocateDepthMap(int width, int height);
   GLuint AllocateCubeDepthMap(int cube_length);
+  // Depth cube map array of cube_count cubes, with storage shared by the views below.
+  GLuint AllocateCubeDepthMapArray(int cube_length, int cube_count);
+  // Cube map viewing one cube of a cube map array, so that it can be rendered into and copied on its own.
+  GLuint AllocateCubeDepthMapView(GLuint cube_array, int cube);
   void DeallocateTexture(GLuint texture);
+
+  // Mip streaming: textures loaded from disk keep their baked mip chain mapped in memory, and only the levels from the
+  // resident base level downwards are uploaded to the GPU.
+  [[nodiscard]] bool IsStreamed(GLuint texture) const { return streamed_textures_.contains(texture); }
+  [[nodiscard]] int MipLevelCount(GLuint texture) const;
+  [[nodiscard]] int ResidentBaseLevel(GLuint texture) const;
+  [[nodiscard]] int Width(GLuint texture) const;
+  [[nodiscard]] int Height(GLuint texture) const;
+  [[nodiscard]] std::span<const uint8_t> MipLevelData(GLuint texture, int level) const;
+  [[nodiscard]] GLenum InternalFormat(GLuint texture) const;
+  [[nodiscard]] bool IsCompressed(GLuint texture) const;
+  [[nodiscard]] size_t MipChainBytes(GLuint texture, int base_level) const;
+  [[nodiscard]] size_t resident_bytes() const { return resident_bytes_; }
+  void SetResidentBaseLevel(GLuint texture, int base_level);
+
+  // Stamps the texture as sampled in the given frame. Textures evicted to stay under the memory budget are uploaded
+  // again from their decoded mip chain, so this has to be called before binding a texture for drawing.
+  void MarkUsed(GLuint texture, uint64_t frame);
+  // Evicts the least recently used textures that were not sampled in the current frame until the textures fit in the
+  // memory budget again.
+  void EnforceMemoryBudget(uint64_t current_frame);
+  [[nodiscard]] bool IsEvicted(GLuint texture) const;
+
  private:
   void InvalidateCache();
   void AllocateUnmappedTextureBlockIfNeeded();
 
+  struct StreamedTexture {
+    BakedTexture baked;
+    // Equal to the number of mip levels when the texture is evicted.
+    int resident_base_level;
+    uint64_t last_used_frame;
+
+    [[nodiscard]] const std::vector<BakedTexture::MipLevel> &mip_levels() const { return baked.mip_levels(); }
+  };
+
+  void UploadMipLevel(const StreamedTexture &streamed_texture, int level);
+  void UpdateResidentLevels(GLuint texture, StreamedTexture &streamed_texture, int base_level);
+
   std::vector<GLuint> unmapped_textures_;
   absl::flat_hash_map<std::filesystem::path, GLuint, std::hash<std::filesystem::path>> texture_creation_cache_;
   absl::flat_hash_map<GLuint, uint32_t> texture_ref_counts_;
+  absl::flat_hash_map<GLuint, StreamedTexture> streamed_textures_;
+  size_t memory_budget_;
+  bool compress_textures_;
+  // Bytes of the resident levels of streamed textures. Render targets are not streamed and stay out of the budget, the
+  // streamer keeps the same total under the same budget.
+  size_t resident_bytes_ = 0;
 };
 }
 
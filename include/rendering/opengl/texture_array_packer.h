@@ -0,0 +1,61 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTURE_ARRAY_PACKER_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTURE_ARRAY_PACKER_H_
+
+#include "rendering/opengl/texture_allocator.h"
+
+#include <vector>
+
+#include <absl/container/flat_hash_map.h>
+#include <GL/glew.h>
+
+namespace chove::rendering::opengl {
+
+// Copies textures loaded through the allocator into GL_TEXTURE_2D_ARRAY textures, one array per distinct size and
+// format, so that materials can reference a layer instead of a texture of their own and objects can share texture
+// bindings.
+class TextureArrayPacker {
+ public:
+  explicit TextureArrayPacker(TextureAllocator &allocator);
+  TextureArrayPacker(const TextureArrayPacker &) = delete;
+  TextureArrayPacker &operator=(const TextureArrayPacker &) = delete;
+  TextureArrayPacker(TextureArrayPacker &&) noexcept = delete;
+  TextureArrayPacker &operator=(TextureArrayPacker &&) noexcept = delete;
+  ~TextureArrayPacker();
+
+  struct Layer {
+    GLuint texture_array;
+    int layer;
+  };
+
+  void AddTexture(GLuint texture);
+  void Pack();
+  [[nodiscard]] Layer GetLayer(GLuint texture) const { return layers_.at(texture); }
+
+  // Deletes the arrays created by the previous Pack call.
+  void Clear();
+
+ private:
+  struct ArrayFormat {
+    int width;
+    int height;
+    GLenum internal_format;
+
+    friend bool operator==(const ArrayFormat &lhs, const ArrayFormat &rhs) {
+      return lhs.width == rhs.width && lhs.height == rhs.height && lhs.internal_format == rhs.internal_format;
+    }
+
+    template<typename H>
+    friend H AbslHashValue(H hash, const ArrayFormat &format) {
+      return H::combine(std::move(hash), format.width, format.height, format.internal_format);
+    }
+  };
+
+  TextureAllocator *allocator_;
+  absl::flat_hash_map<ArrayFormat, std::vector<GLuint>> pending_textures_;
+  absl::flat_hash_map<GLuint, Layer> layers_;
+  std::vector<GLuint> texture_arrays_;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTURE_ARRAY_PACKER_H_
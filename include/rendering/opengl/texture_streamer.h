@@ -0,0 +1,43 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTURE_STREAMER_H_
+#define CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTURE_STREAMER_H_
+
+#include "rendering/opengl/texture_allocator.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <GL/glew.h>
+
+namespace chove::rendering::opengl {
+
+// Decides which mip levels of the streamed textures should be resident, based on how large the objects sampling them
+// are on screen, and moves the allocator towards that state while staying under a memory budget.
+class TextureStreamer {
+ public:
+  TextureStreamer(TextureAllocator &allocator, size_t memory_budget, int mip_uploads_per_frame);
+
+  // Records that the texture is sampled by an object where one unit of texture coordinates covers the given number of
+  // pixels on screen. Multiple requests for the same texture keep the most detailed one.
+  void RequestTexture(GLuint texture, float pixels_per_texcoord);
+
+  // Drops the levels that are no longer needed and uploads a limited number of missing ones.
+  void Update();
+
+ private:
+  struct Request {
+    int desired_base_level;
+    float pixels_per_texcoord;
+  };
+
+  [[nodiscard]] int IdleBaseLevel(GLuint texture) const;
+
+  TextureAllocator *allocator_;
+  size_t memory_budget_;
+  int mip_uploads_per_frame_;
+
+  absl::flat_hash_map<GLuint, Request> requests_;
+  absl::flat_hash_set<GLuint> known_textures_;
+};
+
+}  // namespace chove::rendering::opengl
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_OPENGL_TEXTURE_STREAMER_H_
@@ -152,6 +152,8 @@ class UniformBuffer {
   explicit UniformBuffer(size_t size);
 
   void Bind(GLuint shader_program, const std::string &name, GLint binding);
+  // For buffers bound to a block whose program binding was already set up through another buffer.
+  void SetBinding(GLint binding) { binding_ = binding; }
   void Rebind() const;
 
   void UpdateData(const void *data, size_t size) const;
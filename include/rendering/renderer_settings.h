@@ -0,0 +1,40 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_RENDERER_SETTINGS_H_
+#define CHOVENGINE_INCLUDE_RENDERING_RENDERER_SETTINGS_H_
+
+#include <cstddef>
+#include <filesystem>
+
+namespace chove::rendering {
+
+struct RendererSettings {
+  // Upper bound for the video memory taken by textures loaded from disk, in bytes. Streaming keeps the visible textures
+  // under it by dropping mip levels, and textures that were not sampled recently are evicted altogether. Render targets
+  // such as shadow maps do not count towards it.
+  size_t texture_memory_budget = 512ULL * 1024ULL * 1024ULL;
+  // How many texture mip levels can be uploaded in a single frame while streaming in detail.
+  int texture_mip_uploads_per_frame = 16;
+  // How many shadow map faces can be rendered in a single frame. A point light takes six, the directional light one per
+  // cascade and a spot light one.
+  // Lights left over keep last frame's shadow map, the most important and stalest ones are refreshed first.
+  int shadow_face_updates_per_frame = 12;
+  // Packs material textures of equal size into texture arrays so that objects can share texture bindings. Packed
+  // textures are fully resident and are not streamed.
+  bool pack_material_textures = false;
+  // Bakes textures block compressed by the driver instead of as plain RGBA, trading some quality for an eighth of the
+  // memory. Changing it rebakes the textures on the next load.
+  bool compress_textures = false;
+  // Draws the depth of opaque objects before the main pass, which then only shades the visible fragment of each pixel.
+  // Pays off when expensive fragments are drawn over each other, at the cost of transforming opaque geometry twice.
+  bool depth_prepass = false;
+  // Hides objects behind the largest visible opaque objects, rasterized on the CPU into a coarse depth buffer. Objects
+  // with an OccluderProxy occlude with their proxy instead of their mesh.
+  bool occlusion_culling = false;
+  // Most triangles rasterized as occluders per frame. Proxies come first, then objects by how large they appear.
+  int occluder_triangle_budget = 16384;
+  // Directory where linked shader programs are cached between runs, empty disables the cache.
+  std::filesystem::path shader_cache_directory = "shader_cache";
+};
+
+}  // namespace chove::rendering
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_RENDERER_SETTINGS_H_
@@ -1,14 +1,19 @@
 #ifndef CHOVENGINE_INCLUDE_RENDERING_VULKAN_PIPELINE_BUILDER_H_
 #define CHOVENGINE_INCLUDE_RENDERING_VULKAN_PIPELINE_BUILDER_H_
 
+#include "rendering/vulkan/pipeline_cache.h"
 #include "rendering/vulkan/shader.h"
 
+#include <future>
+
 #include <vulkan/vulkan.hpp>
 
 namespace chove::rendering::vulkan {
 class PipelineBuilder {
  public:
-  explicit PipelineBuilder(vk::Device device);
+  // With a cache the built pipeline and layout are owned by it and shared between builders with equal state,
+  // otherwise the caller owns them.
+  explicit PipelineBuilder(vk::Device device, PipelineCache *cache = nullptr);
 
   PipelineBuilder &SetVertexShader(const Shader &shader);
   PipelineBuilder &SetGeometryShader(const Shader &shader);
@@ -27,9 +32,18 @@ class PipelineBuilder {
   std::pair<vk::Pipeline, vk::PipelineLayout> build(
       vk::RenderPass render_pass, uint32_t subpass, vk::PipelineCreateFlags flags = vk::PipelineCreateFlags{}
   );
+  // Builds a copy of the current state on another thread. The shaders have to stay alive until the future is ready.
+  std::future<std::pair<vk::Pipeline, vk::PipelineLayout>> BuildAsync(
+      vk::RenderPass render_pass, uint32_t subpass, vk::PipelineCreateFlags flags = vk::PipelineCreateFlags{}
+  ) const;
 
  private:
+  [[nodiscard]] PipelineLayoutKey LayoutKey() const;
+  [[nodiscard]] PipelineKey MakePipelineKey(PipelineLayoutKey layout_key, vk::RenderPass render_pass, uint32_t subpass,
+                                            vk::PipelineCreateFlags flags) const;
+
   vk::Device device_;
+  PipelineCache *cache_;
 
   std::vector<const Shader *> shaders_;
   std::vector<vk::PipelineShaderStageCreateInfo> shader_stages_;
@@ -0,0 +1,121 @@
+#ifndef CHOVENGINE_INCLUDE_RENDERING_VULKAN_PIPELINE_CACHE_H_
+#define CHOVENGINE_INCLUDE_RENDERING_VULKAN_PIPELINE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <absl/container/flat_hash_map.h>
+#include <vulkan/vulkan.hpp>
+
+namespace chove::rendering::vulkan {
+
+// Builder state a pipeline layout is created from, per shader. Descriptor set layouts are identified by their bindings,
+// their handles change whenever a shader is loaded again.
+struct PipelineLayoutKey {
+  struct ShaderLayout {
+    size_t descriptor_set_layout_count;
+    std::vector<vk::DescriptorSetLayoutBinding> descriptor_set_layout_bindings;
+    std::vector<vk::PushConstantRange> push_constant_ranges;
+
+    friend bool operator==(const ShaderLayout &lhs, const ShaderLayout &rhs) = default;
+    template <typename H>
+    friend H AbslHashValue(H hash, const ShaderLayout &layout) {
+      return H::combine(std::move(hash),
+                        layout.descriptor_set_layout_count,
+                        layout.descriptor_set_layout_bindings,
+                        layout.push_constant_ranges);
+    }
+  };
+  std::vector<ShaderLayout> shaders;
+
+  friend bool operator==(const PipelineLayoutKey &lhs, const PipelineLayoutKey &rhs) = default;
+  template <typename H>
+  friend H AbslHashValue(H hash, const PipelineLayoutKey &key) {
+    return H::combine(std::move(hash), key.shaders);
+  }
+};
+
+// Builder state a pipeline is created from. Shader modules are identified by their SPIR-V code, the viewport and
+// scissor are left out as they are dynamic state.
+struct PipelineKey {
+  PipelineLayoutKey layout;
+  std::vector<std::pair<VkShaderStageFlags, std::vector<char>>> stages;
+  std::vector<vk::VertexInputBindingDescription> vertex_input_bindings;
+  std::vector<vk::VertexInputAttributeDescription> vertex_input_attributes;
+  vk::PipelineInputAssemblyStateCreateInfo input_assembly;
+  vk::PipelineTessellationStateCreateInfo tessellation;
+  vk::PipelineRasterizationStateCreateInfo rasterization;
+  vk::PipelineColorBlendAttachmentState color_blend_attachment;
+  vk::PipelineMultisampleStateCreateInfo multisample;
+  vk::PipelineDepthStencilStateCreateInfo depth_stencil;
+  VkRenderPass render_pass;
+  uint32_t subpass;
+  VkPipelineCreateFlags flags;
+
+  friend bool operator==(const PipelineKey &lhs, const PipelineKey &rhs) = default;
+  template <typename H>
+  friend H AbslHashValue(H hash, const PipelineKey &key) {
+    return H::combine(std::move(hash),
+                      key.layout,
+                      key.stages,
+                      key.vertex_input_bindings,
+                      key.vertex_input_attributes,
+                      key.input_assembly,
+                      key.tessellation,
+                      key.rasterization,
+                      key.color_blend_attachment,
+                      key.multisample,
+                      key.depth_stencil,
+                      key.render_pass,
+                      key.subpass,
+                      key.flags);
+  }
+};
+
+// Owns every pipeline and pipeline layout built by PipelineBuilder, keyed by the full builder state, so building
+// the same state twice returns the existing objects. The driver side VkPipelineCache is loaded from and saved to disk,
+// which makes pipelines that were already compiled in a previous run cheap to create. Safe to use from several threads.
+class PipelineCache {
+ public:
+  // An empty path keeps the driver cache in memory only.
+  PipelineCache(vk::Device device, vk::PhysicalDevice physical_device, std::filesystem::path path);
+  PipelineCache(const PipelineCache &) = delete;
+  PipelineCache &operator=(const PipelineCache &) = delete;
+  PipelineCache(PipelineCache &&) = delete;
+  PipelineCache &operator=(PipelineCache &&) = delete;
+  ~PipelineCache();
+
+  [[nodiscard]] vk::PipelineCache cache() const { return cache_; }
+
+  // Returns the object stored under the key, calling create only if there is none. Concurrent requests for the same
+  // key wait for the first one instead of creating the object again.
+  vk::PipelineLayout GetOrCreateLayout(const PipelineLayoutKey &key, const std::function<vk::PipelineLayout()> &create);
+  vk::Pipeline GetOrCreatePipeline(const PipelineKey &key, const std::function<vk::Pipeline()> &create);
+
+  // Writes the driver cache to disk. Also done on destruction.
+  void Save() const;
+
+ private:
+  template <typename Key, typename T>
+  T GetOrCreate(absl::flat_hash_map<Key, std::shared_future<T>> &objects, const Key &key,
+                const std::function<T()> &create);
+
+  vk::Device device_;
+  vk::PhysicalDeviceProperties device_properties_;
+  std::filesystem::path path_;
+  vk::PipelineCache cache_;
+
+  std::mutex mutex_;
+  absl::flat_hash_map<PipelineLayoutKey, std::shared_future<vk::PipelineLayout>> layouts_;
+  absl::flat_hash_map<PipelineKey, std::shared_future<vk::Pipeline>> pipelines_;
+};
+
+}  // namespace chove::rendering::vulkan
+
+#endif  // CHOVENGINE_INCLUDE_RENDERING_VULKAN_PIPELINE_CACHE_H_
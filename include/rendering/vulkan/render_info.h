@@ -6,6 +6,7 @@
 
 namespace chove::rendering::vulkan {
 
+// Vertex and index buffers are shared by every entity drawing the same mesh.
 struct RenderInfo {
   vk::Buffer vertex_buffer;
   vk::Buffer index_buffer;
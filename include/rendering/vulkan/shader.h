@@ -18,8 +18,13 @@ class Shader {
   Shader &operator=(Shader &&) noexcept;
 
   [[nodiscard]] vk::ShaderModule module() const { return shader_; }
+  // Identifies the shader, unlike the module handle it stays the same when the shader is loaded again.
+  [[nodiscard]] const std::vector<char> &code() const { return code_; }
   [[nodiscard]] const std::vector<vk::DescriptorSetLayout> &descriptor_set_layouts() const { return descriptor_set_layouts_; }
   [[nodiscard]] const std::vector<vk::PushConstantRange> &push_constant_ranges() const { return push_constant_ranges_; }
+  [[nodiscard]] const std::vector<vk::DescriptorSetLayoutBinding> &descriptor_set_layout_bindings() const {
+    return descriptor_set_layout_bindings_;
+  }
 
   vk::DescriptorSetLayout AddDescriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding> &bindings);
   void AddPushConstantRanges(const std::vector<vk::PushConstantRange> &ranges);
@@ -28,6 +33,7 @@ class Shader {
  private:
   vk::Device device_;
   vk::ShaderModule shader_;
+  std::vector<char> code_;
   std::vector<vk::DescriptorSetLayout> descriptor_set_layouts_;
   std::vector<vk::DescriptorSetLayoutBinding> descriptor_set_layout_bindings_;
   std::vector<vk::PushConstantRange> push_constant_ranges_;
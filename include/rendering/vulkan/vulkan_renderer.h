@@ -2,12 +2,15 @@
 #define CHOVENGINE_INCLUDE_RENDERING_VULKAN_VULKAN_RENDERER_H_
 
 #include "objects/scene.h"
+#include "rendering/frustum_culler.h"
 #include "rendering/renderer.h"
 #include "rendering/vulkan/allocator.h"
 #include "rendering/vulkan/context.h"
+#include "rendering/vulkan/pipeline_cache.h"
 #include "rendering/vulkan/shader.h"
 #include "windowing/window.h"
 
+#include <memory>
 #include <stack>
 #include <thread>
 #include <vector>
@@ -84,10 +87,20 @@ class VulkanRenderer final : public Renderer {
   std::vector<vk::DescriptorSet> descriptor_sets_;
 
   std::vector<Shader> shaders_;
+  // Owns the pipelines and layouts below.
+  std::unique_ptr<PipelineCache> pipeline_cache_;
   std::vector<vk::Pipeline> pipelines_;
   std::vector<vk::PipelineLayout> pipeline_layouts_;
 
   objects::Scene *scene_ = nullptr;
+  // Only touched by the render thread.
+  FrustumCuller frustum_culler_;
+  std::vector<entt::entity> culled_entities_;
+  std::vector<uint32_t> visible_objects_;
+  // Model view projection matrix of every visible object, one buffer per frame in flight. Visible objects of one mesh
+  // are adjacent in it and drawn with one instanced draw.
+  std::array<vk::Buffer, kMaxFramesInFlight> instance_buffers_{};
+  std::array<void *, kMaxFramesInFlight> instance_buffer_memory_{};
 
   bool is_running_ = false;
   bool render_thread_finished_ = false;
@@ -1,12 +1,26 @@
 layout(location = 0) in vec3 position;
-layout(location = 1) in vec2 texCoord;
+layout(location = 2) in vec2 texCoord;
+// Base instance of the draw plus the instance, which indexes the caster instances.
+layout(location = 4) in uint drawIndex;
 
-uniform mat4 model;
+// One entry per shadow caster drawn, matching Renderer::ShadowInstance.
+struct ShadowInstance {
+    mat4 model;
+    int faceMask;
+};
+
+layout (std430, binding = 0) readonly buffer Instances {
+    ShadowInstance instances[];
+};
+
+// The camera's view projection matrix in the depth pre-pass, which the main pass tests against for equal depth.
 uniform mat4 lightSpaceMatrix;
 
+invariant gl_Position;
+
 out vec2 fragTexCoord;
 
 void main() {
     fragTexCoord = texCoord;
-    gl_Position = lightSpaceMatrix * model * vec4(position, 1.0);
+    gl_Position = lightSpaceMatrix * (instances[drawIndex].model * vec4(position, 1.0));
 }
@@ -0,0 +1,23 @@
+layout(location = 0) in vec3 position;
+layout(location = 2) in vec2 texCoord;
+// Base instance of the draw plus the instance, which indexes the caster instances.
+layout(location = 4) in uint drawIndex;
+
+// One entry per shadow caster drawn, matching Renderer::ShadowInstance.
+struct ShadowInstance {
+    mat4 model;
+    int faceMask;
+};
+
+layout (std430, binding = 0) readonly buffer Instances {
+    ShadowInstance instances[];
+};
+
+out vec2 geomTexCoord;
+flat out int geomFaceMask;
+
+void main() {
+    geomTexCoord = texCoord;
+    geomFaceMask = instances[drawIndex].faceMask;
+    gl_Position = instances[drawIndex].model * vec4(position, 1.0);
+}
@@ -0,0 +1,11 @@
+out vec4 outColor;
+
+uniform vec3 color;
+
+in vec3 fragNormalEye;
+
+// Stand-in for objects whose shader variant is still compiling, lit by a fixed light at the camera.
+void main() {
+    float diffuse = max(dot(normalize(fragNormalEye), vec3(0.0f, 0.0f, 1.0f)), 0.0f);
+    outColor = vec4(color * (0.2f + 0.8f * diffuse), 1.0f);
+}
@@ -0,0 +1,19 @@
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+
+uniform mat4 model;
+
+layout (std140, binding = 0) uniform Matrices {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+};
+
+invariant gl_Position;
+
+out vec3 fragNormalEye;
+
+void main() {
+    fragNormalEye = normalize(mat3(view * model) * normal);
+    gl_Position = viewProjection * (model * vec4(position, 1.0f));
+}
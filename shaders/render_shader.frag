@@ -21,7 +21,8 @@ struct PointLight {
     float ambient;
 
     vec3 positionEyeSpace;
-    float pad0;
+    // Cube of pointShadowMaps holding the light's shadows, -1 for lights drawn without shadows.
+    int shadowLayer;
 };
 
 struct SpotLight {
@@ -40,27 +41,33 @@ struct SpotLight {
     float pad0;
 };
 
-uniform sampler2D ambientTexture;
-uniform sampler2D diffuseTexture;
-uniform sampler2D specularTexture;
-uniform sampler2D shininessTexture;
-uniform sampler2D alphaTexture;
-uniform sampler2D bumpTexture;
-uniform sampler2D displacementTexture;
-
-#if DIRECTIONAL_LIGHT_COUNT > 0
-uniform sampler2DShadow directionalDepthMaps[DIRECTIONAL_LIGHT_COUNT];
+#ifdef TEXTURE_ARRAYS
+    #define MATERIAL_SAMPLER sampler2DArray
+    #define SAMPLE_MATERIAL(textureArray, layer, uv) texture(textureArray, vec3(uv, float(layer)))
+#else
+    #define MATERIAL_SAMPLER sampler2D
+    #define SAMPLE_MATERIAL(textureSampler, layer, uv) texture(textureSampler, uv)
 #endif
 
-#if SPOT_LIGHT_COUNT > 0
-uniform sampler2DShadow spotDepthMaps[SPOT_LIGHT_COUNT];
+uniform MATERIAL_SAMPLER ambientTexture;
+uniform MATERIAL_SAMPLER diffuseTexture;
+uniform MATERIAL_SAMPLER specularTexture;
+uniform MATERIAL_SAMPLER shininessTexture;
+uniform sampler2D alphaTexture;
+uniform MATERIAL_SAMPLER bumpTexture;
+uniform MATERIAL_SAMPLER displacementTexture;
+
+// Directional and spot light shadow maps are tiles of one atlas, placed by the atlasRect of each light.
+#if DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
+uniform sampler2DShadow shadowAtlas;
 #endif
 
+// Point light shadow maps are cubes of one array, only a few lights get one.
 #if POINT_LIGHT_COUNT > 0
-uniform samplerCubeShadow pointDepthMaps[POINT_LIGHT_COUNT];
+uniform samplerCubeArrayShadow pointShadowMaps;
 #endif
 
-layout (std140) uniform Material {
+struct Material {
     float shininess;
     float opticalDensity;
     float dissolve;
@@ -68,29 +75,86 @@ layout (std140) uniform Material {
     vec3 ambientColor;
     vec3 specularColor;
     vec3 transmissionFilterColor;
+    ivec4 textureLayers[2];
+};
+
+// Every material of the scene, matching Renderer::MaterialData.
+layout (std430, binding = 1) readonly buffer Materials {
+    Material materials[];
 };
 
-layout (std140) uniform Lights {
+#define AMBIENT_LAYER material.textureLayers[0].x
+#define DIFFUSE_LAYER material.textureLayers[0].y
+#define SPECULAR_LAYER material.textureLayers[0].z
+#define SHININESS_LAYER material.textureLayers[0].w
+#define BUMP_LAYER material.textureLayers[1].y
+#define DISPLACEMENT_LAYER material.textureLayers[1].z
+
+// Directional lights are split in cascades along the view distance, matching kDirectionalCascadeCount.
+#define DIRECTIONAL_CASCADE_COUNT 4
+#define LIGHT_SPACE_COUNT (DIRECTIONAL_LIGHT_COUNT * DIRECTIONAL_CASCADE_COUNT + SPOT_LIGHT_COUNT)
+
+struct LightSpace {
+    mat4 matrix;
+    vec4 atlasRect;
+};
+
+#if LIGHT_SPACE_COUNT > 0
+layout (std430, binding = 6) readonly buffer LightSpaces {
+    // Distance from the camera where each cascade ends.
+    vec4 cascadeSplits;
+    // The cascades of every directional light, then the spot lights.
+    LightSpace lightSpaces[];
+};
+#endif
+
 #if DIRECTIONAL_LIGHT_COUNT > 0
+layout (std140, binding = 2) uniform Lights {
     DirectionalLight directionalLights[DIRECTIONAL_LIGHT_COUNT];
+};
 #endif
+
+// Point and spot lights are only shaded by the clusters they reach, see LightGrid.
 #if POINT_LIGHT_COUNT > 0
-    PointLight pointLights[POINT_LIGHT_COUNT];
+layout (std430, binding = 2) readonly buffer PointLights {
+    PointLight pointLights[];
+};
 #endif
+
 #if SPOT_LIGHT_COUNT > 0
-    SpotLight spotLights[SPOT_LIGHT_COUNT];
+// The cutoffs are cosines of the cone's half angles here.
+layout (std430, binding = 3) readonly buffer SpotLights {
+    SpotLight spotLights[];
+};
 #endif
+
+#if POINT_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
+// Set in the light indices of spot lights, matching LightGrid::kSpotLightBit.
+#define SPOT_LIGHT_BIT 0x80000000u
+
+layout (std430, binding = 4) readonly buffer LightClusters {
+    // Clusters across the screen and along the view depth.
+    uvec4 clusterCounts;
+    // Size of a cluster in pixels, then the scale and bias turning the logarithm of a view depth into a depth slice.
+    vec4 clusterParams;
+    // Offset into lightIndices and number of lights of every cluster.
+    uvec2 clusterRanges[];
+};
+
+layout (std430, binding = 5) readonly buffer LightIndices {
+    uint lightIndices[];
 };
+#endif
 
 in vec3 fragNormal;
 in vec2 fragTexCoord;
 in vec4 fragPosEye;
 in vec4 fragPosWorld;
 in mat3 TBN;
+flat in uint fragMaterialIndex;
 
-#if DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
-in vec4 fragPosLightSpace[DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT];
-#endif
+// Material of the draw, read once from the material buffer.
+Material material;
 
 float specularStrength = 0.5f;
 
@@ -104,30 +168,35 @@ vec3 totalAmbient = vec3(0.0f);
 vec3 totalDiffuse = vec3(0.0f);
 vec3 totalSpecular = vec3(0.0f);
 
+// Surface normal and direction towards the camera in eye space, shared by every light.
+vec3 normalEye;
+vec3 viewDirN;
+
 float directionalDepthBias = 0.005f;
 float pointDepthBias = 0.00005f;
+float spotDepthBias = 0.0005f;
 
 void ComputeLightComponents() {
     #ifdef NO_AMBIENT_TEXTURE
         #ifdef NO_DIFFUSE_TEXTURE
-            ambient *= ambientColor;
+            ambient *= material.ambientColor;
         #else
-            ambient *= texture(diffuseTexture, texCoord).xyz * ambientColor;
+            ambient *= SAMPLE_MATERIAL(diffuseTexture, DIFFUSE_LAYER, texCoord).xyz * material.ambientColor;
         #endif
     #else
-        ambient *= texture(ambientTexture, texCoord).xyz * ambientColor;
+        ambient *= SAMPLE_MATERIAL(ambientTexture, AMBIENT_LAYER, texCoord).xyz * material.ambientColor;
     #endif
 
     #ifdef NO_DIFFUSE_TEXTURE
-        diffuse *= diffuseColor;
+        diffuse *= material.diffuseColor;
     #else
-        diffuse *= texture(diffuseTexture, texCoord).xyz * diffuseColor;
+        diffuse *= SAMPLE_MATERIAL(diffuseTexture, DIFFUSE_LAYER, texCoord).xyz * material.diffuseColor;
     #endif
 
     #ifdef NO_SPECULAR_TEXTURE
-        specular *= specularColor;
+        specular *= material.specularColor;
     #else
-        specular *= texture(specularTexture, texCoord).xyz * specularColor;
+        specular *= SAMPLE_MATERIAL(specularTexture, SPECULAR_LAYER, texCoord).xyz * material.specularColor;
     #endif
 
     totalAmbient += ambient;
@@ -135,50 +204,59 @@ void ComputeLightComponents() {
     totalSpecular += specular;
 }
 
-#if DIRECTIONAL_LIGHT_COUNT > 0
-void ComputeDirectionalLight() {
-    vec3 cameraPosEye = vec3(0.0f);
-
-    #ifdef NO_BUMP_TEXTURE
-        vec3 normalEye = normalize(fragNormal);  // interpolated normals are not normalized
+float SpecularCoefficient(vec3 halfVector) {
+    #ifdef NO_SHININESS_TEXTURE
+        return pow(max(dot(normalEye, halfVector), 0.0f), material.shininess);
     #else
-        vec3 normalEye = normalize(texture(bumpTexture, texCoord).xyz * 2.0 - 1.0);
-        normalEye = normalize(inverse(TBN) * normalEye);
+        return pow(max(dot(normalEye, halfVector), 0.0f), SAMPLE_MATERIAL(shininessTexture, SHININESS_LAYER, texCoord).r);
     #endif
-    vec3 viewDirN = normalize(cameraPosEye - fragPosEye.xyz);  // compute view direction
+}
+
+#if LIGHT_SPACE_COUNT > 0
+// Percentage closer filtering of a light's tile in the shadow atlas, tileCoordinates going from zero to one across the
+// tile. Samples are kept half a texel inside the tile so the filter does not reach into the neighbouring ones. The
+// atlas has no mipmaps, so explicit zero gradients change nothing but let spot lights sample it in non-uniform control
+// flow.
+float SampleShadowAtlas(int lightSpaceIndex, vec3 tileCoordinates) {
+    vec4 atlasRect = lightSpaces[lightSpaceIndex].atlasRect;
+    vec2 texelSize = 1.0f / vec2(textureSize(shadowAtlas, 0));
+    vec2 tileMin = atlasRect.zw + 0.5f * texelSize;
+    vec2 tileMax = atlasRect.zw + atlasRect.xy - 0.5f * texelSize;
+    vec2 atlasCoordinates = tileCoordinates.xy * atlasRect.xy + atlasRect.zw;
+
+    float totalShadow = 0.0f;
+    for (int dx = -2; dx <= 2; ++dx) {
+        for (int dy = -2; dy <= 2; ++dy) {
+            vec2 sampleCoordinates = clamp(atlasCoordinates + vec2(dx, dy) * texelSize, tileMin, tileMax);
+            totalShadow += textureGrad(shadowAtlas, vec3(sampleCoordinates, tileCoordinates.z), vec2(0.0f), vec2(0.0f));
+        }
+    }
+    return totalShadow / 16.0f;
+}
+#endif
 
+#if DIRECTIONAL_LIGHT_COUNT > 0
+void ComputeDirectionalLight() {
     for (int i = 0; i < DIRECTIONAL_LIGHT_COUNT; ++i) {
         vec3 lightDirN = normalize(directionalLights[i].direction);  // compute light direction
         vec3 halfVector = normalize(lightDirN + viewDirN);  // compute half vector
         ambient = directionalLights[i].ambient * directionalLights[i].color;
 
-        vec3 depthMapCoordinates = ((fragPosLightSpace[i].xyz / fragPosLightSpace[i].w) * 0.5f + 0.5) - vec3(0.0f, 0.0f, directionalDepthBias);
-
-        float totalShadow = 0.0f;
-        for (int dx = -2; dx <= 2; ++dx) {
-            for (int dy = -2; dy <= 2; ++dy) {
-                float shadowCoeff = texture(directionalDepthMaps[i], depthMapCoordinates.xyz + vec3(dx, dy, 0.0f) / 2048.0f);
-                totalShadow += shadowCoeff;
-            }
+        // Fragments beyond the last cascade are out of shadow range and fully lit.
+        float shadow = 1.0f;
+        int cascade = 0;
+        while (cascade < DIRECTIONAL_CASCADE_COUNT && -fragPosEye.z > cascadeSplits[cascade]) {
+            cascade++;
         }
-        float shadow = totalShadow / 16.0f;
-
-        if (depthMapCoordinates.x < 0.001f || depthMapCoordinates.x > 0.999f || depthMapCoordinates.y < 0.001f || depthMapCoordinates.y > 0.999f) {
-            shadow = 0.0f;
-        }
-
-        if (depthMapCoordinates.z > 1.0f) {
-            shadow = 0.0f;
+        if (cascade < DIRECTIONAL_CASCADE_COUNT) {
+            int lightSpaceIndex = i * DIRECTIONAL_CASCADE_COUNT + cascade;
+            vec4 fragPosLightSpace = lightSpaces[lightSpaceIndex].matrix * fragPosWorld;
+            vec3 depthMapCoordinates = ((fragPosLightSpace.xyz / fragPosLightSpace.w) * 0.5f + 0.5) - vec3(0.0f, 0.0f, directionalDepthBias);
+            shadow = SampleShadowAtlas(lightSpaceIndex, depthMapCoordinates);
         }
 
         diffuse = shadow * max(dot(normalEye, lightDirN), 0.0f) * directionalLights[i].color;
-
-        #ifdef NO_SHININESS_TEXTURE
-            float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
-        #else
-            float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), texture(shininessTexture, texCoord).r);
-        #endif
-        specular = shadow * specularStrength * specCoeff * directionalLights[i].color;
+        specular = shadow * specularStrength * SpecularCoefficient(halfVector) * directionalLights[i].color;
 
         ComputeLightComponents();
     }
@@ -197,71 +275,118 @@ float GetProjectedDepth(vec3 v, float n, float f)
     return (worldSpaceZ + 1.0) * 0.5;
 }
 
-void ComputePointLight() {
-    vec3 cameraPosEye = vec3(0.0f);
+// The cube is picked by a texture coordinate, so lights of a cluster may sample different ones. Cube map array shadow
+// samplers take no explicit gradients, but the shadow maps have no mipmaps, so the implicit ones texture() computes in
+// the non-uniform control flow of the cluster loop do not change the result.
+float SamplePointShadow(int layer, vec3 fragToLight, float depth) {
+    float totalShadow = 0.0f;
+    for (int dx = -2; dx <= 2; ++dx) {
+        for (int dy = -2; dy <= 2; ++dy) {
+            vec4 sampleCoordinates = vec4(normalize(fragToLight) + vec3(dx, dy, 0.0f) / 2048.0f, float(layer));
+            totalShadow += texture(pointShadowMaps, sampleCoordinates, depth - pointDepthBias);
+        }
+    }
+    return totalShadow / 16.0f;
+}
 
-    #ifdef NO_BUMP_TEXTURE
-        vec3 normalEye = normalize(fragNormal);  // interpolated normals are not normalized
-    #else
-        vec3 normalEye = normalize(texture(bumpTexture, texCoord).xyz * 2.0 - 1.0);
-        normalEye = normalize(inverse(TBN) * normalEye);
-    #endif
-    vec3 viewDirN = normalize(cameraPosEye - fragPosEye.xyz);  // compute view direction
+void ComputePointLight(int i) {
+    vec3 lightDirN = normalize(pointLights[i].positionEyeSpace - fragPosEye.xyz);  // compute light direction
+    vec3 halfVector = normalize(lightDirN + viewDirN);  // compute half vector
+    float dist = length(pointLights[i].positionEyeSpace - fragPosEye.xyz);
+    float attenuation = 1.0f / (pointLights[i].constant + pointLights[i].linear * dist + pointLights[i].quadratic * dist * dist);
 
-    for (int i = 0; i < POINT_LIGHT_COUNT; ++i) {
-        vec3 lightDirN = normalize(pointLights[i].positionEyeSpace - fragPosEye.xyz);  // compute light direction
-        vec3 halfVector = normalize(lightDirN + viewDirN);  // compute half vector
-        float dist = length(pointLights[i].positionEyeSpace - fragPosEye.xyz);
-        float attenuation = 1.0f / (pointLights[i].constant + pointLights[i].linear * dist + pointLights[i].quadratic * dist * dist);
+    vec3 fragToLight = fragPosWorld.xyz - pointLights[i].position;
+    float depth = GetProjectedDepth(fragToLight, pointLights[i].near_plane, pointLights[i].far_plane);
+    int layer = pointLights[i].shadowLayer;
+    float shadow = layer < 0 ? 1.0f : SamplePointShadow(layer, fragToLight, depth);
 
-        vec3 fragToLight = fragPosWorld.xyz - pointLights[i].position;
-        float depth = GetProjectedDepth(fragToLight, pointLights[i].near_plane, pointLights[i].far_plane);
+    ambient = attenuation * pointLights[i].ambient * pointLights[i].color;
+    diffuse = shadow * attenuation * max(dot(normalEye, lightDirN), 0.0f) * pointLights[i].color;
+    specular = shadow * attenuation * specularStrength * SpecularCoefficient(halfVector) * pointLights[i].color;
 
-        float totalShadow = 0.0f;
-        for (int dx = -2; dx <= 2; ++dx) {
-            for (int dy = -2; dy <= 2; ++dy) {
-                float shadowCoeff = texture(pointDepthMaps[i], vec4(normalize(fragToLight) + vec3(dx, dy, 0.0f) / 2048.0f, depth - pointDepthBias));
-                totalShadow += shadowCoeff;
-            }
-        }
-        float shadow = totalShadow / 16.0f;
+    ComputeLightComponents();
+}
+#endif
 
-        ambient = attenuation * pointLights[i].ambient * pointLights[i].color;
-        diffuse = shadow * attenuation * max(dot(normalEye, lightDirN), 0.0f) * pointLights[i].color;
+#if SPOT_LIGHT_COUNT > 0
+void ComputeSpotLight(int i) {
+    vec3 lightDirN = normalize(spotLights[i].position - fragPosEye.xyz);  // compute light direction
+    vec3 halfVector = normalize(lightDirN + viewDirN);  // compute half vector
+    float dist = length(spotLights[i].position - fragPosEye.xyz);
+    float attenuation = 1.0f / (spotLights[i].constant + spotLights[i].linear * dist + spotLights[i].quadratic * dist * dist);
+    // Full intensity inside the inner cone, fading out towards the outer one.
+    float theta = dot(-lightDirN, normalize(spotLights[i].direction));
+    float cone = smoothstep(spotLights[i].outerCutoff, spotLights[i].innerCutoff, theta);
+
+    // Spot lights follow the directional light cascades in the light spaces. Fragments beyond the far plane of the
+    // shadow map are fully lit, and so are all fragments of lights left without a tile in the atlas.
+    int lightSpaceIndex = DIRECTIONAL_LIGHT_COUNT * DIRECTIONAL_CASCADE_COUNT + i;
+    vec4 fragPosLightSpace = lightSpaces[lightSpaceIndex].matrix * fragPosWorld;
+    vec3 depthMapCoordinates = ((fragPosLightSpace.xyz / fragPosLightSpace.w) * 0.5f + 0.5) - vec3(0.0f, 0.0f, spotDepthBias);
+    bool unshadowed = lightSpaces[lightSpaceIndex].atlasRect.x == 0.0f || depthMapCoordinates.z > 1.0f;
+    float shadow = unshadowed ? 1.0f : SampleShadowAtlas(lightSpaceIndex, depthMapCoordinates);
+
+    ambient = cone * attenuation * spotLights[i].ambient * spotLights[i].color;
+    diffuse = shadow * cone * attenuation * max(dot(normalEye, lightDirN), 0.0f) * spotLights[i].color;
+    specular = shadow * cone * attenuation * specularStrength * SpecularCoefficient(halfVector) * spotLights[i].color;
+
+    ComputeLightComponents();
+}
+#endif
 
-        #ifdef NO_SHININESS_TEXTURE
-            float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
-        #else
-            float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), texture(shininessTexture, texCoord).r);
+#if POINT_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
+// Shades the point and spot lights of the cluster the fragment falls in.
+void ComputeClusteredLights() {
+    uvec2 tile = uvec2(gl_FragCoord.xy / clusterParams.xy);
+    float slice = clamp(log(-fragPosEye.z) * clusterParams.z + clusterParams.w, 0.0f, float(clusterCounts.z - 1u));
+    uvec2 range = clusterRanges[(uint(slice) * clusterCounts.y + tile.y) * clusterCounts.x + tile.x];
+
+    for (uint j = range.x; j < range.x + range.y; ++j) {
+        uint light = lightIndices[j];
+        #if SPOT_LIGHT_COUNT > 0
+            if ((light & SPOT_LIGHT_BIT) != 0u) {
+                ComputeSpotLight(int(light & ~SPOT_LIGHT_BIT));
+                continue;
+            }
+        #endif
+        #if POINT_LIGHT_COUNT > 0
+            ComputePointLight(int(light));
         #endif
-        specular = shadow * attenuation * specularStrength * specCoeff * pointLights[i].color;
-
-        ComputeLightComponents();
     }
 }
 #endif
 
 vec2 ParralaxMapping(vec2 texCoord, vec3 viewDir) {
-    float height = texture(displacementTexture, texCoord).r;
+    float height = SAMPLE_MATERIAL(displacementTexture, DISPLACEMENT_LAYER, texCoord).r;
     vec2 p = viewDir.xy / viewDir.z * height * 0.05f;
     return texCoord - p;
 }
 
 void main() {
+    material = materials[fragMaterialIndex];
+
     #ifdef NO_DISPLACEMENT_TEXTURE
         texCoord = fragTexCoord;
     #else
         texCoord = ParralaxMapping(fragTexCoord, TBN * normalize(-fragPosEye.xyz));
     #endif
 
+    #ifdef NO_BUMP_TEXTURE
+        normalEye = normalize(fragNormal);  // interpolated normals are not normalized
+    #else
+        normalEye = normalize(SAMPLE_MATERIAL(bumpTexture, BUMP_LAYER, texCoord).xyz * 2.0 - 1.0);
+        normalEye = normalize(inverse(TBN) * normalEye);
+    #endif
+    viewDirN = normalize(-fragPosEye.xyz);  // compute view direction, the camera sits at the eye space origin
+
     #if DIRECTIONAL_LIGHT_COUNT > 0
         ComputeDirectionalLight();
     #endif
-    #if POINT_LIGHT_COUNT > 0
-        ComputePointLight();
+    #if POINT_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
+        ComputeClusteredLights();
     #endif
 
-    float alpha = dissolve;
+    float alpha = material.dissolve;
     #ifndef NO_ALPHA_TEXTURE
         alpha *= texture(alphaTexture, texCoord).r;
     #endif
@@ -270,9 +395,9 @@ void main() {
         outColor = vec4(min(totalAmbient + totalDiffuse + totalSpecular, 1.0f), alpha);
     #else
         #ifdef NO_DIFFUSE_TEXTURE
-            outColor = vec4(diffuseColor, 1.0f);
+            outColor = vec4(material.diffuseColor, 1.0f);
         #else
-            outColor = vec4(texture(diffuseTexture, fragTexCoord).xyz, 1.0f);
+            outColor = vec4(SAMPLE_MATERIAL(diffuseTexture, DIFFUSE_LAYER, fragTexCoord).xyz, 1.0f);
         #endif
     #endif
 }
\ No newline at end of file
@@ -2,48 +2,52 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texcoord;
 layout(location = 3) in vec3 tangent;
+// Base instance of the draw plus the instance, which indexes the per-draw data.
+layout(location = 4) in uint drawIndex;
+
+// One entry per draw of the main pass, matching Renderer::DrawData.
+struct DrawData {
+    mat4 model;
+    mat4 normalMatrix;
+    // Index into the material buffer of the fragment shader.
+    uint materialIndex;
+};
 
-uniform mat4 model;
-uniform mat3 normalMatrix;
+layout (std430, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
 
-layout (std140) uniform Matrices {
+layout (std140, binding = 0) uniform Matrices {
     mat4 view;
     mat4 projection;
+    mat4 viewProjection;
 };
 
-layout (std140) uniform LightSpaceMatrices {
-#if DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
-    mat4 lightSpaceMatrices[DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT];
-#endif
-};
+// Computed exactly like in the depth pre-pass, which the main pass tests against for equal depth.
+invariant gl_Position;
 
 out vec3 fragNormal;
 out vec2 fragTexCoord;
 out vec4 fragPosEye;
 out vec4 fragPosWorld;
 out mat3 TBN;
-
-#if DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
-out vec4 fragPosLightSpace[DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT];
-#endif
+flat out uint fragMaterialIndex;
 
 void main() {
-    fragPosEye = view * model * vec4(position, 1.0f);
+    mat4 model = draws[drawIndex].model;
+    mat3 normalMatrix = mat3(draws[drawIndex].normalMatrix);
+    fragMaterialIndex = draws[drawIndex].materialIndex;
+
     fragPosWorld = model * vec4(position, 1.0f);
+    fragPosEye = view * fragPosWorld;
     fragNormal = normalize(normalMatrix * normal);
     fragTexCoord = texcoord;
 
-#if DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT > 0
-    for (int i = 0; i < DIRECTIONAL_LIGHT_COUNT + SPOT_LIGHT_COUNT; i++) {
-        fragPosLightSpace[i] = lightSpaceMatrices[i] * model * vec4(position, 1.0f);
-    }
-#endif
-
     vec3 T = normalize((view * model * vec4(tangent, 0.0f)).xyz);
     vec3 N = normalize((view * model * vec4(normal, 0.0f)).xyz);
     vec3 B = cross(N, T);
 
     TBN = transpose(mat3(T, B, N));
 
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    gl_Position = viewProjection * fragPosWorld;
 }
@@ -2,15 +2,13 @@
 
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec3 normal;
+// Per instance, takes up locations 2 to 5.
+layout(location = 2) in mat4 modelViewProjection;
 
 layout(location = 0) out vec3 color;
 
-layout(push_constant) uniform PushConstants {
-    mat4 mvp;
-} push;
-
 void main() {
-    gl_Position = push.mvp * position;
+    gl_Position = modelViewProjection * position;
     color = normal;
 
     gl_Position.y = -gl_Position.y;
@@ -33,10 +33,10 @@ void Application::Run() {
     }
   }
 }
-Application::Application(windowing::RendererType renderer_type) :
+Application::Application(windowing::RendererType renderer_type, rendering::RendererSettings renderer_settings) :
     window_(windowing::Window::Create("Chove", {1024, 800}, renderer_type)) {
   if (renderer_type == windowing::RendererType::kOpenGL) {
-    renderer_ = std::make_unique<rendering::opengl::Renderer>(&window_);
+    renderer_ = std::make_unique<rendering::opengl::Renderer>(&window_, renderer_settings);
   }
   else if (renderer_type == windowing::RendererType::kVulkan) {
     renderer_ = std::make_unique<rendering::vulkan::VulkanRenderer>(rendering::vulkan::VulkanRenderer::Create(window_));
@@ -0,0 +1,162 @@
+#include "rendering/frustum_culler.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CHOVENGINE_FRUSTUM_CULLER_SSE
+#endif
+
+namespace chove::rendering {
+
+namespace {
+
+#if defined(__AVX__)
+constexpr size_t kLanes = 8;
+#elif defined(CHOVENGINE_FRUSTUM_CULLER_SSE)
+constexpr size_t kLanes = 4;
+#else
+constexpr size_t kLanes = 1;
+#endif
+
+struct SoaBounds {
+  const float *center_x;
+  const float *center_y;
+  const float *center_z;
+  const float *extent_x;
+  const float *extent_y;
+  const float *extent_z;
+};
+
+// A box is outside when it lies entirely behind one of the planes, that is when the signed distance of its center is
+// below minus the projection of its extents onto the plane normal. Each function returns a bit per lane, set for the
+// boxes that are not outside any plane.
+#if defined(__AVX__)
+uint32_t TestLanes(const Frustum &frustum, const SoaBounds &bounds, size_t first) {
+  const __m256 center_x = _mm256_loadu_ps(bounds.center_x + first);
+  const __m256 center_y = _mm256_loadu_ps(bounds.center_y + first);
+  const __m256 center_z = _mm256_loadu_ps(bounds.center_z + first);
+  const __m256 extent_x = _mm256_loadu_ps(bounds.extent_x + first);
+  const __m256 extent_y = _mm256_loadu_ps(bounds.extent_y + first);
+  const __m256 extent_z = _mm256_loadu_ps(bounds.extent_z + first);
+  __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (const glm::vec4 &plane : frustum.planes) {
+    __m256 distance = _mm256_add_ps(_mm256_mul_ps(center_x, _mm256_set1_ps(plane.x)), _mm256_set1_ps(plane.w));
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(center_y, _mm256_set1_ps(plane.y)));
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(center_z, _mm256_set1_ps(plane.z)));
+    __m256 radius = _mm256_mul_ps(extent_x, _mm256_set1_ps(std::abs(plane.x)));
+    radius = _mm256_add_ps(radius, _mm256_mul_ps(extent_y, _mm256_set1_ps(std::abs(plane.y))));
+    radius = _mm256_add_ps(radius, _mm256_mul_ps(extent_z, _mm256_set1_ps(std::abs(plane.z))));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+  }
+  return static_cast<uint32_t>(_mm256_movemask_ps(inside));
+}
+#elif defined(CHOVENGINE_FRUSTUM_CULLER_SSE)
+uint32_t TestLanes(const Frustum &frustum, const SoaBounds &bounds, size_t first) {
+  const __m128 center_x = _mm_loadu_ps(bounds.center_x + first);
+  const __m128 center_y = _mm_loadu_ps(bounds.center_y + first);
+  const __m128 center_z = _mm_loadu_ps(bounds.center_z + first);
+  const __m128 extent_x = _mm_loadu_ps(bounds.extent_x + first);
+  const __m128 extent_y = _mm_loadu_ps(bounds.extent_y + first);
+  const __m128 extent_z = _mm_loadu_ps(bounds.extent_z + first);
+  __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+  for (const glm::vec4 &plane : frustum.planes) {
+    __m128 distance = _mm_add_ps(_mm_mul_ps(center_x, _mm_set1_ps(plane.x)), _mm_set1_ps(plane.w));
+    distance = _mm_add_ps(distance, _mm_mul_ps(center_y, _mm_set1_ps(plane.y)));
+    distance = _mm_add_ps(distance, _mm_mul_ps(center_z, _mm_set1_ps(plane.z)));
+    __m128 radius = _mm_mul_ps(extent_x, _mm_set1_ps(std::abs(plane.x)));
+    radius = _mm_add_ps(radius, _mm_mul_ps(extent_y, _mm_set1_ps(std::abs(plane.y))));
+    radius = _mm_add_ps(radius, _mm_mul_ps(extent_z, _mm_set1_ps(std::abs(plane.z))));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+  }
+  return static_cast<uint32_t>(_mm_movemask_ps(inside));
+}
+#else
+uint32_t TestLanes(const Frustum &frustum, const SoaBounds &bounds, size_t first) {
+  for (const glm::vec4 &plane : frustum.planes) {
+    const float distance = plane.x * bounds.center_x[first] + plane.y * bounds.center_y[first] +
+                           plane.z * bounds.center_z[first] + plane.w;
+    const float radius = std::abs(plane.x) * bounds.extent_x[first] + std::abs(plane.y) * bounds.extent_y[first] +
+                         std::abs(plane.z) * bounds.extent_z[first];
+    if (distance + radius < 0.0F) {
+      return 0;
+    }
+  }
+  return 1;
+}
+#endif
+
+}  // namespace
+
+Frustum Frustum::FromMatrix(const glm::mat4 &view_projection) {
+  const glm::mat4 rows = glm::transpose(view_projection);
+  return Frustum{{
+      rows[3] + rows[0],  // Left
+      rows[3] - rows[0],  // Right
+      rows[3] + rows[1],  // Bottom
+      rows[3] - rows[1],  // Top
+      rows[3] + rows[2],  // Near
+      rows[3] - rows[2],  // Far
+  }};
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3 &center, float radius) const {
+  // The planes are not normalized, so the radius is scaled by the length of each normal instead.
+  return std::ranges::all_of(planes, [&](const glm::vec4 &plane) {
+    return glm::dot(glm::vec3(plane), center) + plane.w >= -radius * glm::length(glm::vec3(plane));
+  });
+}
+
+void FrustumCuller::Clear() {
+  center_x_.clear();
+  center_y_.clear();
+  center_z_.clear();
+  extent_x_.clear();
+  extent_y_.clear();
+  extent_z_.clear();
+  count_ = 0;
+}
+
+void FrustumCuller::Add(const Mesh::BoundingBox &world_bounds) {
+  if (count_ == center_x_.size()) {
+    const size_t padded_size = count_ + kLanes;
+    center_x_.resize(padded_size);
+    center_y_.resize(padded_size);
+    center_z_.resize(padded_size);
+    extent_x_.resize(padded_size);
+    extent_y_.resize(padded_size);
+    extent_z_.resize(padded_size);
+  }
+  const glm::vec3 center = world_bounds.center();
+  const glm::vec3 extents = (world_bounds.max - world_bounds.min) / 2.0F;
+  center_x_[count_] = center.x;
+  center_y_[count_] = center.y;
+  center_z_[count_] = center.z;
+  extent_x_[count_] = extents.x;
+  extent_y_[count_] = extents.y;
+  extent_z_[count_] = extents.z;
+  count_++;
+}
+
+void FrustumCuller::Cull(const Frustum &frustum, std::vector<uint32_t> &visible) const {
+  visible.clear();
+  const SoaBounds bounds{
+      center_x_.data(), center_y_.data(), center_z_.data(), extent_x_.data(), extent_y_.data(), extent_z_.data()
+  };
+  for (size_t first = 0; first < count_; first += kLanes) {
+    uint32_t inside = TestLanes(frustum, bounds, first);
+    if (count_ - first < kLanes) {
+      inside &= (1U << (count_ - first)) - 1;
+    }
+    while (inside != 0) {
+      visible.push_back(static_cast<uint32_t>(first) + std::countr_zero(inside));
+      inside &= inside - 1;
+    }
+  }
+}
+
+}  // namespace chove::rendering
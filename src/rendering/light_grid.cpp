@@ -0,0 +1,322 @@
+#include "rendering/light_grid.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#include <absl/log/check.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CHOVENGINE_LIGHT_GRID_SSE
+#endif
+
+namespace chove::rendering {
+
+namespace {
+
+#if defined(__AVX__)
+constexpr int kLanes = 8;
+#elif defined(CHOVENGINE_LIGHT_GRID_SSE)
+constexpr int kLanes = 4;
+#else
+constexpr int kLanes = 1;
+#endif
+
+constexpr int kClustersPerSlice = LightGrid::kClustersX * LightGrid::kClustersY;
+static_assert(kClustersPerSlice % kLanes == 0, "Slices are tested in whole SIMD lanes");
+
+struct SoaClusters {
+  const float *min_x;
+  const float *min_y;
+  const float *min_z;
+  const float *max_x;
+  const float *max_y;
+  const float *max_z;
+  const float *center_x;
+  const float *center_y;
+  const float *center_z;
+  const float *radius;
+};
+
+// A light reaches a cluster when the sphere of its range overlaps the cluster's box, and the sphere around the box is
+// not entirely outside the light's cone. The cone test takes the distance from the sphere's center to the cone's side
+// in the plane of the axis, which is conservative behind the apex. Each function returns a bit per lane, set for the
+// clusters the light reaches.
+#if defined(__AVX__)
+uint32_t TestLanes(
+    const SoaClusters &clusters, size_t first, const glm::vec3 &position, float range, const glm::vec3 &direction,
+    float cos_angle, float sin_angle
+) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 light_x = _mm256_set1_ps(position.x);
+  const __m256 light_y = _mm256_set1_ps(position.y);
+  const __m256 light_z = _mm256_set1_ps(position.z);
+  const __m256 outside_x = _mm256_max_ps(
+      _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(clusters.min_x + first), light_x),
+                    _mm256_sub_ps(light_x, _mm256_loadu_ps(clusters.max_x + first))),
+      zero
+  );
+  const __m256 outside_y = _mm256_max_ps(
+      _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(clusters.min_y + first), light_y),
+                    _mm256_sub_ps(light_y, _mm256_loadu_ps(clusters.max_y + first))),
+      zero
+  );
+  const __m256 outside_z = _mm256_max_ps(
+      _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(clusters.min_z + first), light_z),
+                    _mm256_sub_ps(light_z, _mm256_loadu_ps(clusters.max_z + first))),
+      zero
+  );
+  __m256 distance = _mm256_mul_ps(outside_x, outside_x);
+  distance = _mm256_add_ps(distance, _mm256_mul_ps(outside_y, outside_y));
+  distance = _mm256_add_ps(distance, _mm256_mul_ps(outside_z, outside_z));
+  const __m256 in_range = _mm256_cmp_ps(distance, _mm256_set1_ps(range * range), _CMP_LE_OQ);
+
+  const __m256 to_center_x = _mm256_sub_ps(_mm256_loadu_ps(clusters.center_x + first), light_x);
+  const __m256 to_center_y = _mm256_sub_ps(_mm256_loadu_ps(clusters.center_y + first), light_y);
+  const __m256 to_center_z = _mm256_sub_ps(_mm256_loadu_ps(clusters.center_z + first), light_z);
+  __m256 squared_length = _mm256_mul_ps(to_center_x, to_center_x);
+  squared_length = _mm256_add_ps(squared_length, _mm256_mul_ps(to_center_y, to_center_y));
+  squared_length = _mm256_add_ps(squared_length, _mm256_mul_ps(to_center_z, to_center_z));
+  __m256 along_axis = _mm256_mul_ps(to_center_x, _mm256_set1_ps(direction.x));
+  along_axis = _mm256_add_ps(along_axis, _mm256_mul_ps(to_center_y, _mm256_set1_ps(direction.y)));
+  along_axis = _mm256_add_ps(along_axis, _mm256_mul_ps(to_center_z, _mm256_set1_ps(direction.z)));
+  const __m256 across_axis =
+      _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(squared_length, _mm256_mul_ps(along_axis, along_axis)), zero));
+  const __m256 to_side = _mm256_sub_ps(
+      _mm256_mul_ps(across_axis, _mm256_set1_ps(cos_angle)), _mm256_mul_ps(along_axis, _mm256_set1_ps(sin_angle))
+  );
+  const __m256 in_cone = _mm256_cmp_ps(to_side, _mm256_loadu_ps(clusters.radius + first), _CMP_LE_OQ);
+  return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_and_ps(in_range, in_cone)));
+}
+#elif defined(CHOVENGINE_LIGHT_GRID_SSE)
+uint32_t TestLanes(
+    const SoaClusters &clusters, size_t first, const glm::vec3 &position, float range, const glm::vec3 &direction,
+    float cos_angle, float sin_angle
+) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 light_x = _mm_set1_ps(position.x);
+  const __m128 light_y = _mm_set1_ps(position.y);
+  const __m128 light_z = _mm_set1_ps(position.z);
+  const __m128 outside_x = _mm_max_ps(
+      _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(clusters.min_x + first), light_x),
+                 _mm_sub_ps(light_x, _mm_loadu_ps(clusters.max_x + first))),
+      zero
+  );
+  const __m128 outside_y = _mm_max_ps(
+      _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(clusters.min_y + first), light_y),
+                 _mm_sub_ps(light_y, _mm_loadu_ps(clusters.max_y + first))),
+      zero
+  );
+  const __m128 outside_z = _mm_max_ps(
+      _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(clusters.min_z + first), light_z),
+                 _mm_sub_ps(light_z, _mm_loadu_ps(clusters.max_z + first))),
+      zero
+  );
+  __m128 distance = _mm_mul_ps(outside_x, outside_x);
+  distance = _mm_add_ps(distance, _mm_mul_ps(outside_y, outside_y));
+  distance = _mm_add_ps(distance, _mm_mul_ps(outside_z, outside_z));
+  const __m128 in_range = _mm_cmple_ps(distance, _mm_set1_ps(range * range));
+
+  const __m128 to_center_x = _mm_sub_ps(_mm_loadu_ps(clusters.center_x + first), light_x);
+  const __m128 to_center_y = _mm_sub_ps(_mm_loadu_ps(clusters.center_y + first), light_y);
+  const __m128 to_center_z = _mm_sub_ps(_mm_loadu_ps(clusters.center_z + first), light_z);
+  __m128 squared_length = _mm_mul_ps(to_center_x, to_center_x);
+  squared_length = _mm_add_ps(squared_length, _mm_mul_ps(to_center_y, to_center_y));
+  squared_length = _mm_add_ps(squared_length, _mm_mul_ps(to_center_z, to_center_z));
+  __m128 along_axis = _mm_mul_ps(to_center_x, _mm_set1_ps(direction.x));
+  along_axis = _mm_add_ps(along_axis, _mm_mul_ps(to_center_y, _mm_set1_ps(direction.y)));
+  along_axis = _mm_add_ps(along_axis, _mm_mul_ps(to_center_z, _mm_set1_ps(direction.z)));
+  const __m128 across_axis =
+      _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(squared_length, _mm_mul_ps(along_axis, along_axis)), zero));
+  const __m128 to_side =
+      _mm_sub_ps(_mm_mul_ps(across_axis, _mm_set1_ps(cos_angle)), _mm_mul_ps(along_axis, _mm_set1_ps(sin_angle)));
+  const __m128 in_cone = _mm_cmple_ps(to_side, _mm_loadu_ps(clusters.radius + first));
+  return static_cast<uint32_t>(_mm_movemask_ps(_mm_and_ps(in_range, in_cone)));
+}
+#else
+uint32_t TestLanes(
+    const SoaClusters &clusters, size_t first, const glm::vec3 &position, float range, const glm::vec3 &direction,
+    float cos_angle, float sin_angle
+) {
+  const glm::vec3 box_min(clusters.min_x[first], clusters.min_y[first], clusters.min_z[first]);
+  const glm::vec3 box_max(clusters.max_x[first], clusters.max_y[first], clusters.max_z[first]);
+  const glm::vec3 outside = glm::max(glm::max(box_min - position, position - box_max), glm::vec3(0.0F));
+  if (glm::dot(outside, outside) > range * range) {
+    return 0;
+  }
+  const glm::vec3 to_center =
+      glm::vec3(clusters.center_x[first], clusters.center_y[first], clusters.center_z[first]) - position;
+  const float along_axis = glm::dot(to_center, direction);
+  const float across_axis = std::sqrt(std::max(glm::dot(to_center, to_center) - along_axis * along_axis, 0.0F));
+  return across_axis * cos_angle - along_axis * sin_angle <= clusters.radius[first] ? 1 : 0;
+}
+#endif
+
+}  // namespace
+
+LightGrid::LightGrid() :
+    min_x_(kClusterCount),
+    min_y_(kClusterCount),
+    min_z_(kClusterCount),
+    max_x_(kClusterCount),
+    max_y_(kClusterCount),
+    max_z_(kClusterCount),
+    center_x_(kClusterCount),
+    center_y_(kClusterCount),
+    center_z_(kClusterCount),
+    radius_(kClusterCount),
+    ranges_(kClusterCount) {}
+
+void LightGrid::SetView(const glm::mat4 &projection, float near_plane, float far_plane, int width, int height) {
+  CHECK(width > 0 && height > 0) << "Light grid needs a screen of at least one pixel, got " << width << "x" << height;
+  if (projection == projection_ && near_plane == near_plane_ && far_plane == far_plane_ && width == width_ &&
+      height == height_) {
+    return;
+  }
+  projection_ = projection;
+  near_plane_ = near_plane;
+  far_plane_ = far_plane;
+  width_ = width;
+  height_ = height;
+
+  // Tiles are whole pixels, so the last tile in each direction may reach past the screen.
+  const int tile_width = (width + kClustersX - 1) / kClustersX;
+  const int tile_height = (height + kClustersY - 1) / kClustersY;
+  const float depth_ratio = std::log(far_plane / near_plane);
+  params_ = glm::vec4(
+      static_cast<float>(tile_width),
+      static_cast<float>(tile_height),
+      static_cast<float>(kClustersZ) / depth_ratio,
+      -static_cast<float>(kClustersZ) * std::log(near_plane) / depth_ratio
+  );
+
+  // View space directions through the corners of every tile, scaled to a view depth of one.
+  const glm::mat4 inverse_projection = glm::inverse(projection);
+  std::vector<glm::vec3> corner_directions((kClustersX + 1) * (kClustersY + 1));
+  for (int y = 0; y <= kClustersY; ++y) {
+    for (int x = 0; x <= kClustersX; ++x) {
+      const float ndc_x = 2.0F * static_cast<float>(x * tile_width) / static_cast<float>(width) - 1.0F;
+      const float ndc_y = 2.0F * static_cast<float>(y * tile_height) / static_cast<float>(height) - 1.0F;
+      const glm::vec4 near_corner = inverse_projection * glm::vec4(ndc_x, ndc_y, -1.0F, 1.0F);
+      const glm::vec3 corner = glm::vec3(near_corner) / near_corner.w;
+      corner_directions[y * (kClustersX + 1) + x] = corner / -corner.z;
+    }
+  }
+
+  for (int z = 0; z < kClustersZ; ++z) {
+    const float near_depth = near_plane * std::pow(far_plane / near_plane, static_cast<float>(z) / kClustersZ);
+    const float far_depth = near_plane * std::pow(far_plane / near_plane, static_cast<float>(z + 1) / kClustersZ);
+    for (int y = 0; y < kClustersY; ++y) {
+      for (int x = 0; x < kClustersX; ++x) {
+        glm::vec3 box_min(std::numeric_limits<float>::max());
+        glm::vec3 box_max(std::numeric_limits<float>::lowest());
+        for (const int corner_y : {y, y + 1}) {
+          for (const int corner_x : {x, x + 1}) {
+            const glm::vec3 &corner_direction = corner_directions[corner_y * (kClustersX + 1) + corner_x];
+            for (const float depth : {near_depth, far_depth}) {
+              box_min = glm::min(box_min, corner_direction * depth);
+              box_max = glm::max(box_max, corner_direction * depth);
+            }
+          }
+        }
+        const size_t cluster = (z * kClustersY + y) * kClustersX + x;
+        min_x_[cluster] = box_min.x;
+        min_y_[cluster] = box_min.y;
+        min_z_[cluster] = box_min.z;
+        max_x_[cluster] = box_max.x;
+        max_y_[cluster] = box_max.y;
+        max_z_[cluster] = box_max.z;
+        const glm::vec3 center = (box_min + box_max) / 2.0F;
+        center_x_[cluster] = center.x;
+        center_y_[cluster] = center.y;
+        center_z_[cluster] = center.z;
+        radius_[cluster] = glm::length(box_max - box_min) / 2.0F;
+      }
+    }
+  }
+}
+
+void LightGrid::AddPointLight(const glm::vec3 &position, float range) {
+  lights_.push_back(Light{position, range, glm::vec3(0.0F, 0.0F, -1.0F), -1.0F, 0.0F, point_light_count_++});
+}
+
+void LightGrid::AddSpotLight(const glm::vec3 &position, const glm::vec3 &direction, float outer_angle, float range) {
+  // Cones wider than a half space are only culled by their range.
+  const bool wide = outer_angle >= glm::radians(90.0F);
+  lights_.push_back(Light{
+      position,
+      range,
+      glm::normalize(direction),
+      wide ? -1.0F : std::cos(outer_angle),
+      wide ? 0.0F : std::sin(outer_angle),
+      kSpotLightBit | spot_light_count_++
+  });
+}
+
+void LightGrid::Assign() {
+  const SoaClusters clusters{
+      min_x_.data(),
+      min_y_.data(),
+      min_z_.data(),
+      max_x_.data(),
+      max_y_.data(),
+      max_z_.data(),
+      center_x_.data(),
+      center_y_.data(),
+      center_z_.data(),
+      radius_.data()
+  };
+  assignments_.clear();
+  for (const Light &light : lights_) {
+    // View space looks down negative z.
+    const float depth = -light.position.z;
+    if (depth + light.range < near_plane_ || depth - light.range > far_plane_) {
+      continue;
+    }
+    const size_t first_cluster = static_cast<size_t>(Slice(depth - light.range)) * kClustersPerSlice;
+    const size_t last_cluster = static_cast<size_t>(Slice(depth + light.range) + 1) * kClustersPerSlice;
+    for (size_t first = first_cluster; first < last_cluster; first += kLanes) {
+      uint32_t reached =
+          TestLanes(clusters, first, light.position, light.range, light.direction, light.cos_angle, light.sin_angle);
+      while (reached != 0) {
+        assignments_.emplace_back(static_cast<uint32_t>(first) + std::countr_zero(reached), light.index);
+        reached &= reached - 1;
+      }
+    }
+  }
+
+  // Counting sort by cluster, which keeps the lights of a cluster in the order they were added.
+  for (Range &range : ranges_) {
+    range = {0, 0};
+  }
+  for (const auto &[cluster, _] : assignments_) {
+    ranges_[cluster].count++;
+  }
+  uint32_t offset = 0;
+  for (Range &range : ranges_) {
+    range.offset = offset;
+    offset += range.count;
+    range.count = 0;
+  }
+  light_indices_.resize(assignments_.size());
+  for (const auto &[cluster, light] : assignments_) {
+    Range &range = ranges_[cluster];
+    light_indices_[range.offset + range.count++] = light;
+  }
+
+  lights_.clear();
+  point_light_count_ = 0;
+  spot_light_count_ = 0;
+}
+
+int LightGrid::Slice(float depth) const {
+  const float slice = std::log(std::max(depth, near_plane_)) * params_.z + params_.w;
+  return static_cast<int>(std::clamp(slice, 0.0F, static_cast<float>(kClustersZ - 1)));
+}
+
+}  // namespace chove::rendering
@@ -114,9 +114,9 @@ Mesh::BoundingBox ComputeBoundingBox(const std::vector<Mesh::Vertex> &vertices)
   float min_x = std::numeric_limits<float>::max();
   float min_y = std::numeric_limits<float>::max();
   float min_z = std::numeric_limits<float>::max();
-  float max_x = std::numeric_limits<float>::min();
-  float max_y = std::numeric_limits<float>::min();
-  float max_z = std::numeric_limits<float>::min();
+  float max_x = std::numeric_limits<float>::lowest();
+  float max_y = std::numeric_limits<float>::lowest();
+  float max_z = std::numeric_limits<float>::lowest();
   for (const auto &vertex : vertices) {
     min_x = std::min(min_x, vertex.position.x);
     min_y = std::min(min_y, vertex.position.y);
@@ -128,6 +128,24 @@ Mesh::BoundingBox ComputeBoundingBox(const std::vector<Mesh::Vertex> &vertices)
   return Mesh::BoundingBox{.min = glm::vec3(min_x, min_y, min_z), .max = glm::vec3(max_x, max_y, max_z)};
 }
 
+float ComputeTexcoordDensity(const std::vector<Mesh::Vertex> &vertices, const std::vector<uint32_t> &indices) {
+  float position_area = 0.0F;
+  float texcoord_area = 0.0F;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const Mesh::Vertex &v0 = vertices[indices[i]];
+    const Mesh::Vertex &v1 = vertices[indices[i + 1]];
+    const Mesh::Vertex &v2 = vertices[indices[i + 2]];
+    position_area += glm::length(glm::cross(v1.position - v0.position, v2.position - v0.position));
+    const glm::vec2 delta_uv1 = v1.texcoord - v0.texcoord;
+    const glm::vec2 delta_uv2 = v2.texcoord - v0.texcoord;
+    texcoord_area += std::abs(delta_uv1.x * delta_uv2.y - delta_uv2.x * delta_uv1.y);
+  }
+  if (position_area <= 0.0F) {
+    return 0.0F;
+  }
+  return std::sqrt(texcoord_area / position_area);
+}
+
 void CheckErrors(const std::filesystem::path &path, const tinyobj::ObjReader &reader) {
   if (!reader.Error().empty()) {
     LOG(FATAL) << "TinyObjReader error: " << reader.Error();
@@ -147,6 +165,18 @@ void CheckErrors(const std::filesystem::path &path, const tinyobj::ObjReader &re
 
 }  // namespace
 
+Mesh::BoundingBox Mesh::BoundingBox::Transformed(const glm::mat4 &matrix) const {
+  // Arvo's method: project the box extents onto each axis of the transformed space.
+  const glm::vec3 local_center = center();
+  const glm::vec3 local_extents = (max - min) / 2.0F;
+  const glm::vec3 world_center = glm::vec3(matrix * glm::vec4(local_center, 1.0F));
+  glm::vec3 world_extents{0.0F};
+  for (int axis = 0; axis < 3; ++axis) {
+    world_extents += glm::abs(glm::vec3(matrix[axis])) * local_extents[axis];
+  }
+  return BoundingBox{.min = world_center - world_extents, .max = world_center + world_extents};
+}
+
 std::vector<Mesh> Mesh::ImportFromObj(const std::filesystem::path &path) {
   tinyobj::ObjReaderConfig reader_config;
   reader_config.mtl_search_path = path.parent_path().string();
@@ -171,8 +201,11 @@ std::vector<Mesh> Mesh::ImportFromObj(const std::filesystem::path &path) {
   for (const auto &shape : obj_shapes) {
     auto [final_vertices, colors, indices] = ParseObjShape(attrib, shape);
     BoundingBox bounding_box = ComputeBoundingBox(final_vertices);
+    float texcoord_density = ComputeTexcoordDensity(final_vertices, indices);
 
-    meshes.emplace_back(final_vertices, colors, indices, mesh_materials[shape.mesh.material_ids[0]], bounding_box);
+    meshes.emplace_back(
+        final_vertices, colors, indices, mesh_materials[shape.mesh.material_ids[0]], bounding_box, texcoord_density
+    );
   }
 
   LOG(INFO) << "Finished importing meshes from " << path;
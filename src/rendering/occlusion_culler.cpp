@@ -0,0 +1,371 @@
+#include "rendering/occlusion_culler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CHOVENGINE_OCCLUSION_CULLER_SSE
+#endif
+
+namespace chove::rendering {
+
+namespace {
+
+#if defined(__AVX__)
+constexpr int kLanes = 8;
+#elif defined(CHOVENGINE_OCCLUSION_CULLER_SSE)
+constexpr int kLanes = 4;
+#else
+constexpr int kLanes = 1;
+#endif
+
+// Depth of pixels no occluder covers, behind everything.
+constexpr float kEmptyDepth = std::numeric_limits<float>::max();
+
+// Edge functions and depth plane of a triangle along one row of pixels, as slopes in x and values at x = 0.
+struct RowSetup {
+  std::array<float, 3> edge_slopes;
+  std::array<float, 3> edge_offsets;
+  float depth_slope;
+  float depth_offset;
+  float max_depth;
+};
+
+// Each function rasterizes the pixels x to x + kLanes - 1 of a row, keeping the nearer of the old depth and the one of
+// the triangle where the pixel center is inside all three edges.
+#if defined(__AVX__)
+void RasterizeLanes(const RowSetup &setup, float *row, int x) {
+  const __m256 px =
+      _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x) + 0.5F), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+  __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (int edge = 0; edge < 3; ++edge) {
+    const __m256 value = _mm256_add_ps(
+        _mm256_mul_ps(px, _mm256_set1_ps(setup.edge_slopes[edge])), _mm256_set1_ps(setup.edge_offsets[edge])
+    );
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_GE_OQ));
+  }
+  __m256 depth = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(setup.depth_slope)), _mm256_set1_ps(setup.depth_offset));
+  depth = _mm256_min_ps(depth, _mm256_set1_ps(setup.max_depth));
+  const __m256 old_depth = _mm256_loadu_ps(row + x);
+  _mm256_storeu_ps(row + x, _mm256_blendv_ps(old_depth, _mm256_min_ps(old_depth, depth), inside));
+}
+#elif defined(CHOVENGINE_OCCLUSION_CULLER_SSE)
+void RasterizeLanes(const RowSetup &setup, float *row, int x) {
+  const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x) + 0.5F), _mm_setr_ps(0, 1, 2, 3));
+  __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+  for (int edge = 0; edge < 3; ++edge) {
+    const __m128 value =
+        _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(setup.edge_slopes[edge])), _mm_set1_ps(setup.edge_offsets[edge]));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(value, _mm_setzero_ps()));
+  }
+  __m128 depth = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(setup.depth_slope)), _mm_set1_ps(setup.depth_offset));
+  depth = _mm_min_ps(depth, _mm_set1_ps(setup.max_depth));
+  const __m128 old_depth = _mm_loadu_ps(row + x);
+  const __m128 nearer = _mm_min_ps(old_depth, depth);
+  _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old_depth)));
+}
+#else
+void RasterizeLanes(const RowSetup &setup, float *row, int x) {
+  const float px = static_cast<float>(x) + 0.5F;
+  for (int edge = 0; edge < 3; ++edge) {
+    if (setup.edge_slopes[edge] * px + setup.edge_offsets[edge] < 0.0F) {
+      return;
+    }
+  }
+  row[x] = std::min(row[x], std::min(setup.depth_slope * px + setup.depth_offset, setup.max_depth));
+}
+#endif
+
+// Edge function of the edge from a to b, positive on the side of counter-clockwise triangles.
+glm::vec3 EdgeFunction(const glm::vec3 &a, const glm::vec3 &b) {
+  return {a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x};
+}
+
+}  // namespace
+
+OcclusionCuller::OcclusionCuller(int width, int height, int thread_count) :
+    width_((width + kLanes - 1) / kLanes * kLanes), height_(height), band_count_(std::max(thread_count, 1)) {
+  int level_width = width_;
+  int level_height = height_;
+  levels_.push_back(DepthLevel{level_width, level_height, std::vector<float>(width_ * height_, kEmptyDepth)});
+  while (level_width > 1 || level_height > 1) {
+    level_width = std::max(1, (level_width + 1) / 2);
+    level_height = std::max(1, (level_height + 1) / 2);
+    levels_.push_back(
+        DepthLevel{level_width, level_height, std::vector<float>(level_width * level_height, kEmptyDepth)}
+    );
+  }
+
+  for (int band = 1; band < band_count_; ++band) {
+    workers_.emplace_back([this, band](const std::stop_token &stop_token) { WorkerLoop(stop_token, band); });
+  }
+}
+
+void OcclusionCuller::Begin(const glm::mat4 &view_projection) {
+  view_projection_ = view_projection;
+  triangles_.clear();
+}
+
+void OcclusionCuller::AddOccluder(
+    const glm::mat4 &model, std::span<const glm::vec3> positions, std::span<const uint32_t> indices
+) {
+  const glm::mat4 model_view_projection = view_projection_ * model;
+  clip_positions_.resize(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    clip_positions_[i] = model_view_projection * glm::vec4(positions[i], 1.0F);
+  }
+  AddTriangles(indices);
+}
+
+void OcclusionCuller::AddOccluder(
+    const glm::mat4 &model, std::span<const Mesh::Vertex> vertices, std::span<const uint32_t> indices
+) {
+  const glm::mat4 model_view_projection = view_projection_ * model;
+  clip_positions_.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    clip_positions_[i] = model_view_projection * glm::vec4(vertices[i].position, 1.0F);
+  }
+  AddTriangles(indices);
+}
+
+void OcclusionCuller::AddTriangles(std::span<const uint32_t> indices) {
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    AddClippedTriangle(
+        clip_positions_[indices[i]], clip_positions_[indices[i + 1]], clip_positions_[indices[i + 2]]
+    );
+  }
+}
+
+void OcclusionCuller::AddClippedTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+  // Clips against the near plane, where z = -w, which leaves at most a quad.
+  const std::array<glm::vec4, 3> triangle{a, b, c};
+  std::array<glm::vec4, 4> polygon{};
+  int vertex_count = 0;
+  for (int i = 0; i < 3; ++i) {
+    const glm::vec4 &current = triangle.at(i);
+    const glm::vec4 &next = triangle.at((i + 1) % 3);
+    const float current_distance = current.z + current.w;
+    const float next_distance = next.z + next.w;
+    if (current_distance >= 0.0F) {
+      polygon.at(vertex_count++) = current;
+    }
+    if ((current_distance >= 0.0F) != (next_distance >= 0.0F)) {
+      const float t = current_distance / (current_distance - next_distance);
+      polygon.at(vertex_count++) = current + (next - current) * t;
+    }
+  }
+
+  std::array<glm::vec3, 4> screen{};
+  for (int i = 0; i < vertex_count; ++i) {
+    const glm::vec4 &clip = polygon.at(i);
+    screen.at(i) = glm::vec3(
+        (clip.x / clip.w * 0.5F + 0.5F) * static_cast<float>(width_),
+        (clip.y / clip.w * 0.5F + 0.5F) * static_cast<float>(height_),
+        clip.z / clip.w
+    );
+  }
+  for (int i = 2; i < vertex_count; ++i) {
+    AddScreenTriangle({screen[0], screen.at(i - 1), screen.at(i)});
+  }
+}
+
+void OcclusionCuller::AddScreenTriangle(std::array<glm::vec3, 3> vertices) {
+  // Both faces occlude, clockwise triangles are turned around.
+  if ((vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) <
+      (vertices[2].x - vertices[0].x) * (vertices[1].y - vertices[0].y)) {
+    std::swap(vertices[1], vertices[2]);
+  }
+  const glm::vec3 ab = vertices[1] - vertices[0];
+  const glm::vec3 ac = vertices[2] - vertices[0];
+  const float area = ab.x * ac.y - ac.x * ab.y;
+  if (!(area > 0.0F)) {
+    return;
+  }
+
+  // Pixels whose center lies in the bounding rectangle of the triangle.
+  Triangle triangle{};
+  const float min_x = std::min({vertices[0].x, vertices[1].x, vertices[2].x});
+  const float min_y = std::min({vertices[0].y, vertices[1].y, vertices[2].y});
+  const float max_x = std::max({vertices[0].x, vertices[1].x, vertices[2].x});
+  const float max_y = std::max({vertices[0].y, vertices[1].y, vertices[2].y});
+  triangle.min_x = static_cast<int>(std::max(std::ceil(min_x - 0.5F), 0.0F));
+  triangle.min_y = static_cast<int>(std::max(std::ceil(min_y - 0.5F), 0.0F));
+  triangle.max_x = static_cast<int>(std::min(std::floor(max_x - 0.5F), static_cast<float>(width_ - 1)));
+  triangle.max_y = static_cast<int>(std::min(std::floor(max_y - 0.5F), static_cast<float>(height_ - 1)));
+  if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y) {
+    return;
+  }
+
+  triangle.edges = {
+      EdgeFunction(vertices[0], vertices[1]), EdgeFunction(vertices[1], vertices[2]),
+      EdgeFunction(vertices[2], vertices[0])
+  };
+  // Solves depth = x * a + y * b + c through the three vertices, then moves c to the farthest corner of a pixel, so
+  // that the depth at a pixel center is never nearer than the triangle anywhere in the pixel.
+  const float depth_x = (ab.z * ac.y - ac.z * ab.y) / area;
+  const float depth_y = (ab.x * ac.z - ac.x * ab.z) / area;
+  triangle.depth_plane = glm::vec3(
+      depth_x,
+      depth_y,
+      vertices[0].z - depth_x * vertices[0].x - depth_y * vertices[0].y + 0.5F * (std::abs(depth_x) + std::abs(depth_y))
+  );
+  triangle.max_depth = std::max({vertices[0].z, vertices[1].z, vertices[2].z});
+  triangles_.push_back(triangle);
+}
+
+void OcclusionCuller::Rasterize() {
+  std::ranges::fill(levels_.front().depths, kEmptyDepth);
+  if (!triangles_.empty()) {
+    {
+      const std::scoped_lock lock(mutex_);
+      generation_++;
+      pending_bands_ = band_count_ - 1;
+    }
+    work_ready_.notify_all();
+    RasterizeBand(0);
+    std::unique_lock lock(mutex_);
+    work_done_.wait(lock, [this] { return pending_bands_ == 0; });
+  }
+  BuildPyramid();
+}
+
+void OcclusionCuller::RasterizeBand(int band) {
+  const int band_height = (height_ + band_count_ - 1) / band_count_;
+  const int first_row = band * band_height;
+  const int last_row = std::min(first_row + band_height, height_) - 1;
+  std::vector<float> &depths = levels_.front().depths;
+  for (const Triangle &triangle : triangles_) {
+    const int min_y = std::max(triangle.min_y, first_row);
+    const int max_y = std::min(triangle.max_y, last_row);
+    RowSetup setup{};
+    for (int edge = 0; edge < 3; ++edge) {
+      setup.edge_slopes[edge] = triangle.edges[edge].x;
+    }
+    setup.depth_slope = triangle.depth_plane.x;
+    setup.max_depth = triangle.max_depth;
+    for (int y = min_y; y <= max_y; ++y) {
+      const float py = static_cast<float>(y) + 0.5F;
+      // Narrows the row down to the centers inside every edge, an edge of slope a holds where a * px + offset >= 0.
+      float span_min = static_cast<float>(triangle.min_x) + 0.5F;
+      float span_max = static_cast<float>(triangle.max_x) + 0.5F;
+      for (int edge = 0; edge < 3; ++edge) {
+        const glm::vec3 &function = triangle.edges[edge];
+        setup.edge_offsets[edge] = function.y * py + function.z;
+        if (function.x > 0.0F) {
+          span_min = std::max(span_min, -setup.edge_offsets[edge] / function.x);
+        } else if (function.x < 0.0F) {
+          span_max = std::min(span_max, -setup.edge_offsets[edge] / function.x);
+        } else if (setup.edge_offsets[edge] < 0.0F) {
+          span_max = span_min - 1.0F;
+        }
+      }
+      if (span_min > span_max) {
+        continue;
+      }
+      setup.depth_offset = triangle.depth_plane.y * py + triangle.depth_plane.z;
+      // Rounding may leave a pixel on either end, which the edge tests sort out. The row is padded to whole lanes.
+      const int first_x = std::max(static_cast<int>(std::floor(span_min - 0.5F)) - 1, triangle.min_x) / kLanes * kLanes;
+      const int last_x = std::min(static_cast<int>(std::floor(span_max - 0.5F)) + 1, triangle.max_x);
+      float *row = depths.data() + static_cast<ptrdiff_t>(y) * width_;
+      for (int x = first_x; x <= last_x; x += kLanes) {
+        RasterizeLanes(setup, row, x);
+      }
+    }
+  }
+}
+
+void OcclusionCuller::BuildPyramid() {
+  for (size_t level = 1; level < levels_.size(); ++level) {
+    const DepthLevel &source = levels_[level - 1];
+    DepthLevel &target = levels_[level];
+    for (int y = 0; y < target.height; ++y) {
+      const int y0 = 2 * y;
+      const int y1 = std::min(2 * y + 1, source.height - 1);
+      for (int x = 0; x < target.width; ++x) {
+        const int x0 = 2 * x;
+        const int x1 = std::min(2 * x + 1, source.width - 1);
+        target.depths[y * target.width + x] = std::max(
+            {source.depths[y0 * source.width + x0],
+             source.depths[y0 * source.width + x1],
+             source.depths[y1 * source.width + x0],
+             source.depths[y1 * source.width + x1]}
+        );
+      }
+    }
+  }
+}
+
+bool OcclusionCuller::IsVisible(const Mesh::BoundingBox &world_bounds) const {
+  glm::vec2 min_screen(std::numeric_limits<float>::max());
+  glm::vec2 max_screen(std::numeric_limits<float>::lowest());
+  float min_depth = std::numeric_limits<float>::max();
+  for (int corner = 0; corner < 8; ++corner) {
+    const glm::vec3 position(
+        (corner & 1) != 0 ? world_bounds.max.x : world_bounds.min.x,
+        (corner & 2) != 0 ? world_bounds.max.y : world_bounds.min.y,
+        (corner & 4) != 0 ? world_bounds.max.z : world_bounds.min.z
+    );
+    const glm::vec4 clip = view_projection_ * glm::vec4(position, 1.0F);
+    if (clip.z < -clip.w) {
+      return true;
+    }
+    const glm::vec2 screen(
+        (clip.x / clip.w * 0.5F + 0.5F) * static_cast<float>(width_),
+        (clip.y / clip.w * 0.5F + 0.5F) * static_cast<float>(height_)
+    );
+    min_screen = glm::min(min_screen, screen);
+    max_screen = glm::max(max_screen, screen);
+    min_depth = std::min(min_depth, clip.z / clip.w);
+  }
+
+  // Every pixel the box's rectangle overlaps, not only the ones whose center it contains.
+  const int min_x = static_cast<int>(std::max(std::floor(min_screen.x), 0.0F));
+  const int min_y = static_cast<int>(std::max(std::floor(min_screen.y), 0.0F));
+  const int max_x = static_cast<int>(std::min(std::floor(max_screen.x), static_cast<float>(width_ - 1)));
+  const int max_y = static_cast<int>(std::min(std::floor(max_screen.y), static_cast<float>(height_ - 1)));
+  if (min_x > max_x || min_y > max_y) {
+    return true;
+  }
+
+  // The finest level at which the rectangle spans at most two texels each way.
+  size_t level = 0;
+  while (level + 1 < levels_.size() &&
+         ((max_x >> level) - (min_x >> level) > 1 || (max_y >> level) - (min_y >> level) > 1)) {
+    level++;
+  }
+  const DepthLevel &depths = levels_[level];
+  for (int y = min_y >> level; y <= max_y >> level; ++y) {
+    for (int x = min_x >> level; x <= max_x >> level; ++x) {
+      if (min_depth <= depths.depths[y * depths.width + x]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void OcclusionCuller::WorkerLoop(const std::stop_token &stop_token, int band) {
+  uint64_t done_generation = 0;
+  while (true) {
+    {
+      std::unique_lock lock(mutex_);
+      if (!work_ready_.wait(lock, stop_token, [&] { return generation_ != done_generation; })) {
+        return;
+      }
+      done_generation = generation_;
+    }
+    RasterizeBand(band);
+    {
+      const std::scoped_lock lock(mutex_);
+      pending_bands_--;
+    }
+    work_done_.notify_one();
+  }
+}
+
+}  // namespace chove::rendering
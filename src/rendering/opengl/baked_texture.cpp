@@ -0,0 +1,382 @@
+#include "rendering/opengl/baked_texture.h"
+
+#include "external/stb_image.h"
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace chove::rendering::opengl {
+namespace {
+constexpr std::array<char, 4> kMagic = {'C', 'T', 'E', 'X'};
+// Version 2 filters mip levels in linear space.
+constexpr uint32_t kVersion = 2;
+constexpr size_t kLevelAlignment = 16;
+constexpr size_t kBytesPerTexel = 4;
+// The color channels are sRGB encoded, alpha is linear.
+constexpr size_t kColorChannels = 3;
+
+struct FileHeader {
+  std::array<char, 4> magic;
+  uint32_t version;
+  // Size and modification time of the source image, a baked file that does not match them is stale.
+  uint64_t source_size;
+  int64_t source_write_time;
+  uint32_t internal_format;
+  uint32_t level_count;
+};
+
+struct LevelHeader {
+  uint32_t width;
+  uint32_t height;
+  uint64_t offset;
+  uint64_t size;
+};
+
+std::filesystem::path BakedPath(const std::filesystem::path &source_path) {
+  std::filesystem::path baked_path = source_path;
+  baked_path += ".ctex";
+  return baked_path;
+}
+
+GLenum ChooseInternalFormat(bool compress) {
+  if (!compress) {
+    return GL_SRGB;
+  }
+  if (!GLEW_EXT_texture_compression_s3tc || !GLEW_EXT_texture_sRGB) {
+    LOG_FIRST_N(WARNING, 1) << "S3TC compressed sRGB textures are not supported, textures are baked uncompressed";
+    return GL_SRGB;
+  }
+  return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+}
+
+float SrgbToLinear(uint8_t value) {
+  static const std::array<float, 256> kTable = [] {
+    std::array<float, 256> table{};
+    for (size_t i = 0; i < table.size(); ++i) {
+      const float srgb = static_cast<float>(i) / 255.0F;
+      table[i] = srgb <= 0.04045F ? srgb / 12.92F : std::pow((srgb + 0.055F) / 1.055F, 2.4F);
+    }
+    return table;
+  }();
+  return kTable[value];
+}
+
+uint8_t LinearToSrgb(float value) {
+  const float srgb = value <= 0.0031308F ? value * 12.92F : 1.055F * std::pow(value, 1.0F / 2.4F) - 0.055F;
+  return static_cast<uint8_t>(std::clamp(std::lround(srgb * 255.0F), 0L, 255L));
+}
+
+// Builds the mip chain on the CPU with a box filter, so that every level can be re-uploaded independently. Colors are
+// averaged in linear space like the driver does for sRGB textures, averaging the encoded values would darken them.
+std::vector<std::vector<uint8_t>> GenerateMipChain(const uint8_t *image_data, int width, int height) {
+  std::vector<std::vector<uint8_t>> mip_chain;
+  mip_chain.emplace_back(image_data, image_data + static_cast<size_t>(width) * height * kBytesPerTexel);
+  while (width > 1 || height > 1) {
+    const int next_width = std::max(1, width / 2);
+    const int next_height = std::max(1, height / 2);
+    const std::vector<uint8_t> &previous = mip_chain.back();
+    std::vector<uint8_t> next(static_cast<size_t>(next_width) * next_height * kBytesPerTexel);
+    for (int y = 0; y < next_height; ++y) {
+      const int y0 = std::min(2 * y, height - 1);
+      const int y1 = std::min(2 * y + 1, height - 1);
+      for (int x = 0; x < next_width; ++x) {
+        const int x0 = std::min(2 * x, width - 1);
+        const int x1 = std::min(2 * x + 1, width - 1);
+        const std::array<size_t, 4> texels = {
+            (static_cast<size_t>(y0) * width + x0) * kBytesPerTexel,
+            (static_cast<size_t>(y0) * width + x1) * kBytesPerTexel,
+            (static_cast<size_t>(y1) * width + x0) * kBytesPerTexel,
+            (static_cast<size_t>(y1) * width + x1) * kBytesPerTexel,
+        };
+        const size_t target = (static_cast<size_t>(y) * next_width + x) * kBytesPerTexel;
+        for (size_t channel = 0; channel < kColorChannels; ++channel) {
+          float sum = 0.0F;
+          for (const size_t texel : texels) {
+            sum += SrgbToLinear(previous[texel + channel]);
+          }
+          next[target + channel] = LinearToSrgb(sum / 4.0F);
+        }
+        int alpha_sum = 0;
+        for (const size_t texel : texels) {
+          alpha_sum += previous[texel + kColorChannels];
+        }
+        next[target + kColorChannels] = static_cast<uint8_t>((alpha_sum + 2) / 4);
+      }
+    }
+    mip_chain.push_back(std::move(next));
+    width = next_width;
+    height = next_height;
+  }
+  return mip_chain;
+}
+
+// Lets the driver compress a level and reads the compressed blocks back.
+std::vector<uint8_t> CompressMipLevel(GLenum internal_format, int width, int height, const std::vector<uint8_t> &rgba) {
+  glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(internal_format), width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+               rgba.data());
+  GLint compressed_size = 0;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressed_size);
+  std::vector<uint8_t> compressed(compressed_size);
+  glGetCompressedTexImage(GL_TEXTURE_2D, 0, compressed.data());
+  return compressed;
+}
+}  // namespace
+
+std::optional<MappedFile> MappedFile::Open(const std::filesystem::path &path) {
+#ifdef _WIN32
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::nullopt;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return std::nullopt;
+  }
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    return std::nullopt;
+  }
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == nullptr) {
+    CloseHandle(mapping);
+    return std::nullopt;
+  }
+  return MappedFile(static_cast<const uint8_t *>(data), static_cast<size_t>(file_size.QuadPart), mapping);
+#else
+  const int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return std::nullopt;
+  }
+  struct stat file_stat {};
+  if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(file);
+    return std::nullopt;
+  }
+  void *data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (data == MAP_FAILED) {
+    return std::nullopt;
+  }
+  return MappedFile(static_cast<const uint8_t *>(data), static_cast<size_t>(file_stat.st_size), nullptr);
+#endif
+}
+
+MappedFile::MappedFile(const uint8_t *data, size_t size, void *native_handle) :
+    data_(data), size_(size), native_handle_(native_handle) {}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept :
+    data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0)),
+    native_handle_(std::exchange(other.native_handle_, nullptr)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    Close();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    native_handle_ = std::exchange(other.native_handle_, nullptr);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+void MappedFile::Close() {
+  if (data_ == nullptr) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(data_);
+  CloseHandle(native_handle_);
+#else
+  munmap(const_cast<uint8_t *>(data_), size_);
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+BakedTexture::BakedTexture(MappedFile file, GLenum internal_format, std::vector<MipLevel> mip_levels) :
+    file_(std::move(file)), internal_format_(internal_format), mip_levels_(std::move(mip_levels)) {}
+
+std::optional<BakedTexture> BakedTexture::Load(const std::filesystem::path &source_path, bool compress) {
+  const GLenum internal_format = ChooseInternalFormat(compress);
+  const std::filesystem::path baked_path = BakedPath(source_path);
+
+  std::error_code error;
+  const uint64_t source_size = std::filesystem::file_size(source_path, error);
+  if (error) {
+    LOG(ERROR) << "Failed to load texture " << source_path << ": " << error.message();
+    return std::nullopt;
+  }
+  const int64_t source_write_time = std::filesystem::last_write_time(source_path).time_since_epoch().count();
+
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    std::optional<MappedFile> file = MappedFile::Open(baked_path);
+    if (file.has_value()) {
+      const std::span<const uint8_t> bytes = file->data();
+      FileHeader header{};
+      if (bytes.size() >= sizeof(FileHeader)) {
+        std::memcpy(&header, bytes.data(), sizeof(FileHeader));
+      }
+      const bool up_to_date = bytes.size() >= sizeof(FileHeader) && header.magic == kMagic &&
+          header.version == kVersion && header.source_size == source_size &&
+          header.source_write_time == source_write_time && header.internal_format == internal_format &&
+          bytes.size() >= sizeof(FileHeader) + header.level_count * sizeof(LevelHeader);
+      if (up_to_date) {
+        std::vector<MipLevel> mip_levels;
+        bool valid = true;
+        for (uint32_t level = 0; level < header.level_count; ++level) {
+          LevelHeader level_header{};
+          std::memcpy(&level_header,
+                      bytes.data() + sizeof(FileHeader) + level * sizeof(LevelHeader),
+                      sizeof(LevelHeader));
+          if (level_header.offset + level_header.size > bytes.size()) {
+            valid = false;
+            break;
+          }
+          mip_levels.push_back(MipLevel{static_cast<int>(level_header.width),
+                                        static_cast<int>(level_header.height),
+                                        bytes.subspan(level_header.offset, level_header.size)});
+        }
+        if (valid && !mip_levels.empty()) {
+          return BakedTexture(std::move(*file), internal_format, std::move(mip_levels));
+        }
+      }
+    }
+
+    if (attempt == 0) {
+      // Release the stale mapping before overwriting the file it maps.
+      file.reset();
+      if (!Bake(source_path, baked_path, internal_format)) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  LOG(ERROR) << "Failed to map baked texture " << baked_path;
+  return std::nullopt;
+}
+
+bool BakedTexture::Bake(const std::filesystem::path &source_path, const std::filesystem::path &baked_path,
+                        GLenum internal_format) {
+  int width, height, channels;
+  stbi_uc *image_data = stbi_load(source_path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (image_data == nullptr) {
+    LOG(ERROR) << "Failed to load texture " << source_path;
+    return false;
+  }
+
+  if ((width & (width - 1)) != 0 || (height & (height - 1)) != 0) {
+    LOG(ERROR) << "Texture " << source_path << " is not a power of two";
+    stbi_image_free(image_data);
+    return false;
+  }
+
+  // Flip the image vertically because OpenGL expects the origin to be in the bottom left corner
+  int bytes_per_row = width * 4;
+  std::vector<char> buffer(bytes_per_row);
+  int half_height = height / 2;
+  for (int row = 0; row < half_height; ++row) {
+    stbi_uc *row0 = image_data + row * bytes_per_row;
+    stbi_uc *row1 = image_data + (height - row - 1) * bytes_per_row;
+    memcpy(buffer.data(), row0, bytes_per_row);
+    memcpy(row0, row1, bytes_per_row);
+    memcpy(row1, buffer.data(), bytes_per_row);
+  }
+
+  std::vector<std::vector<uint8_t>> mip_chain = GenerateMipChain(image_data, width, height);
+  stbi_image_free(image_data);
+
+  if (internal_format != GL_SRGB) {
+    GLuint scratch_texture = 0;
+    glGenTextures(1, &scratch_texture);
+    glBindTexture(GL_TEXTURE_2D, scratch_texture);
+    int level_width = width;
+    int level_height = height;
+    for (std::vector<uint8_t> &level_data : mip_chain) {
+      level_data = CompressMipLevel(internal_format, level_width, level_height, level_data);
+      level_width = std::max(1, level_width / 2);
+      level_height = std::max(1, level_height / 2);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteTextures(1, &scratch_texture);
+  }
+
+  FileHeader header{
+      .magic = kMagic,
+      .version = kVersion,
+      .source_size = std::filesystem::file_size(source_path),
+      .source_write_time = std::filesystem::last_write_time(source_path).time_since_epoch().count(),
+      .internal_format = internal_format,
+      .level_count = static_cast<uint32_t>(mip_chain.size()),
+  };
+  std::vector<LevelHeader> level_headers;
+  uint64_t offset = sizeof(FileHeader) + mip_chain.size() * sizeof(LevelHeader);
+  int level_width = width;
+  int level_height = height;
+  for (const std::vector<uint8_t> &level_data : mip_chain) {
+    offset = (offset + kLevelAlignment - 1) / kLevelAlignment * kLevelAlignment;
+    level_headers.push_back(LevelHeader{static_cast<uint32_t>(level_width),
+                                        static_cast<uint32_t>(level_height),
+                                        offset,
+                                        level_data.size()});
+    offset += level_data.size();
+    level_width = std::max(1, level_width / 2);
+    level_height = std::max(1, level_height / 2);
+  }
+
+  // Write to a temporary file first so that an interrupted bake never leaves a truncated file behind.
+  std::filesystem::path temporary_path = baked_path;
+  temporary_path += ".tmp";
+  {
+    std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!output) {
+      LOG(ERROR) << "Failed to write baked texture " << temporary_path;
+      return false;
+    }
+    output.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+    output.write(reinterpret_cast<const char *>(level_headers.data()),
+                 static_cast<std::streamsize>(level_headers.size() * sizeof(LevelHeader)));
+    for (size_t level = 0; level < mip_chain.size(); ++level) {
+      const auto padding = static_cast<std::streamsize>(level_headers[level].offset) - output.tellp();
+      const std::array<char, kLevelAlignment> zeros{};
+      output.write(zeros.data(), padding);
+      output.write(reinterpret_cast<const char *>(mip_chain[level].data()),
+                   static_cast<std::streamsize>(mip_chain[level].size()));
+    }
+    if (!output) {
+      LOG(ERROR) << "Failed to write baked texture " << temporary_path;
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary_path, baked_path, error);
+  if (error) {
+    LOG(ERROR) << "Failed to write baked texture " << baked_path << ": " << error.message();
+    return false;
+  }
+  LOG(INFO) << "Baked texture " << source_path << " into " << baked_path;
+  return true;
+}
+
+}  // namespace chove::rendering::opengl
@@ -0,0 +1,84 @@
+#include "rendering/opengl/draw_list.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <utility>
+
+namespace chove::rendering::opengl {
+
+namespace {
+
+constexpr int kPassShift = 60;
+constexpr int kTransparentShift = 59;
+
+// Opaque draws: 12 bits of shader variant, 16 bits of material and 31 bits of mesh.
+constexpr int kOpaqueVariantShift = 47;
+constexpr int kOpaqueMaterialShift = 31;
+constexpr uint64_t kVariantMask = (1ULL << 12) - 1;
+constexpr uint64_t kOpaqueMaterialMask = (1ULL << 16) - 1;
+constexpr uint64_t kMeshMask = (1ULL << 31) - 1;
+
+// Transparent draws: 32 bits of inverted depth, 12 bits of shader variant and 15 bits of material.
+constexpr int kTransparentDepthShift = 27;
+constexpr int kTransparentVariantShift = 15;
+constexpr uint64_t kTransparentMaterialMask = (1ULL << 15) - 1;
+
+constexpr int kRadixBits = 8;
+constexpr size_t kRadixBuckets = 1 << kRadixBits;
+
+}  // namespace
+
+uint64_t DrawList::OpaqueKey(DrawPass pass, uint32_t shader_variant, uint32_t material, uint32_t mesh) {
+  return static_cast<uint64_t>(pass) << kPassShift | (shader_variant & kVariantMask) << kOpaqueVariantShift |
+         (material & kOpaqueMaterialMask) << kOpaqueMaterialShift | (mesh & kMeshMask);
+}
+
+uint64_t DrawList::TransparentKey(DrawPass pass, float distance, uint32_t shader_variant, uint32_t material) {
+  // The bits of a non-negative float grow with its value, inverting them puts the farthest draw first.
+  const uint32_t depth = ~std::bit_cast<uint32_t>(std::max(distance, 0.0F));
+  return static_cast<uint64_t>(pass) << kPassShift | 1ULL << kTransparentShift |
+         static_cast<uint64_t>(depth) << kTransparentDepthShift |
+         (shader_variant & kVariantMask) << kTransparentVariantShift | (material & kTransparentMaterialMask);
+}
+
+void DrawList::Sort() {
+  scratch_.resize(commands_.size());
+  for (int shift = 0; shift < 64; shift += kRadixBits) {
+    std::array<size_t, kRadixBuckets> offsets{};
+    for (const Command &command : commands_) {
+      offsets[(command.key >> shift) & (kRadixBuckets - 1)]++;
+    }
+    // Fields are narrower than the key, so many digits are equal in every key and their pass can be skipped.
+    if (std::ranges::find(offsets, commands_.size()) != offsets.end()) {
+      continue;
+    }
+    size_t offset = 0;
+    for (size_t &bucket : offsets) {
+      offset += std::exchange(bucket, offset);
+    }
+    for (const Command &command : commands_) {
+      scratch_[offsets[(command.key >> shift) & (kRadixBuckets - 1)]++] = command;
+    }
+    std::swap(commands_, scratch_);
+  }
+}
+
+void DrawList::SortNearlySorted(std::span<Command> commands) {
+  for (size_t i = 1; i < commands.size(); ++i) {
+    const Command command = commands[i];
+    size_t j = i;
+    for (; j > 0 && commands[j - 1].key > command.key; --j) {
+      commands[j] = commands[j - 1];
+    }
+    commands[j] = command;
+  }
+}
+
+std::span<const DrawList::Command> DrawList::Pass(DrawPass pass) const {
+  const auto pass_of = [](const Command &command) { return static_cast<uint8_t>(command.key >> kPassShift); };
+  const auto [first, last] = std::ranges::equal_range(commands_, static_cast<uint8_t>(pass), {}, pass_of);
+  return {first, last};
+}
+
+}  // namespace chove::rendering::opengl
@@ -0,0 +1,107 @@
+#include "rendering/opengl/frame_ring_buffer.h"
+
+#include <algorithm>
+
+#include <absl/log/log.h>
+
+namespace chove::rendering::opengl {
+
+namespace {
+
+constexpr GLuint64 kFenceTimeoutNanoseconds = 1'000'000'000;
+
+}  // namespace
+
+FrameRingBuffer::FrameRingBuffer() {
+  if (!GLEW_ARB_buffer_storage) {
+    LOG(FATAL) << "Persistently mapped buffers are not supported, ARB_buffer_storage is required";
+  }
+  GLint uniform_alignment = 0;
+  GLint storage_alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+  alignment_ = static_cast<size_t>(std::max({uniform_alignment, storage_alignment, 16}));
+}
+
+FrameRingBuffer::~FrameRingBuffer() {
+  for (GLsync &fence : fences_) {
+    if (fence != nullptr) {
+      glDeleteSync(fence);
+    }
+  }
+  if (buffer_ != 0) {
+    glDeleteBuffers(1, &buffer_);
+  }
+}
+
+void FrameRingBuffer::Reserve(size_t size, size_t allocation_count) {
+  // Every allocation wastes less than the alignment.
+  const size_t region_size = Aligned(size + allocation_count * (alignment_ - 1));
+  if (region_size <= region_size_) {
+    return;
+  }
+  for (int region = 0; region < kFramesInFlight; ++region) {
+    WaitForRegion(region);
+  }
+  if (buffer_ != 0) {
+    glDeleteBuffers(1, &buffer_);
+  }
+
+  region_size_ = region_size;
+  const auto buffer_size = static_cast<GLsizeiptr>(region_size_ * kFramesInFlight);
+  constexpr GLbitfield kFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, buffer_size, nullptr, kFlags);
+  mapped_ = static_cast<std::byte *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, buffer_size, kFlags));
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  if (mapped_ == nullptr) {
+    LOG(FATAL) << "Failed to map the frame ring buffer";
+  }
+  cursor_ = 0;
+}
+
+void FrameRingBuffer::BeginFrame() {
+  region_ = (region_ + 1) % kFramesInFlight;
+  WaitForRegion(region_);
+  cursor_ = 0;
+}
+
+void FrameRingBuffer::EndFrame() {
+  fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::Allocate(size_t size) {
+  if (cursor_ + Aligned(size) > region_size_) {
+    LOG(FATAL) << "Frame ring buffer overflow: " << cursor_ + Aligned(size) << " bytes needed, " << region_size_
+               << " reserved";
+  }
+  const size_t offset = region_ * region_size_ + cursor_;
+  cursor_ += Aligned(size);
+  return {static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), mapped_ + offset};
+}
+
+void FrameRingBuffer::BindRange(GLenum target, GLuint binding, const Allocation &allocation) const {
+  if (allocation.size == 0) {
+    return;
+  }
+  glBindBufferRange(target, binding, buffer_, allocation.offset, allocation.size);
+}
+
+void FrameRingBuffer::WaitForRegion(int region) {
+  GLsync &fence = fences_[region];
+  if (fence == nullptr) {
+    return;
+  }
+  GLenum result = GL_TIMEOUT_EXPIRED;
+  while (result == GL_TIMEOUT_EXPIRED) {
+    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeoutNanoseconds);
+  }
+  if (result == GL_WAIT_FAILED) {
+    LOG(ERROR) << "Waiting for the frame ring buffer fence failed";
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+}  // namespace chove::rendering::opengl
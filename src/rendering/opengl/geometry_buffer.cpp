@@ -0,0 +1,128 @@
+#include "rendering/opengl/geometry_buffer.h"
+
+#include <cstddef>
+#include <numeric>
+
+namespace chove::rendering::opengl {
+
+namespace {
+
+constexpr GLuint kDrawIndexLocation = 4;
+
+}  // namespace
+
+GeometryBuffer::GeometryBuffer() {
+  glGenVertexArrays(1, &vertex_array_);
+  glGenVertexArrays(1, &position_vertex_array_);
+  glGenBuffers(1, &vertex_buffer_);
+  glGenBuffers(1, &index_buffer_);
+  glGenBuffers(1, &draw_index_buffer_);
+
+  glBindVertexArray(vertex_array_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), nullptr);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(
+      1, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), reinterpret_cast<void *>(offsetof(Mesh::Vertex, normal))
+  );
+
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(
+      2, 2, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), reinterpret_cast<void *>(offsetof(Mesh::Vertex, texcoord))
+  );
+
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(
+      3, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), reinterpret_cast<void *>(offsetof(Mesh::Vertex, tangent))
+  );
+
+  glBindBuffer(GL_ARRAY_BUFFER, draw_index_buffer_);
+  glEnableVertexAttribArray(kDrawIndexLocation);
+  glVertexAttribIPointer(kDrawIndexLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+  glVertexAttribDivisor(kDrawIndexLocation, 1);
+
+  // Attributes left disabled read as constants.
+  glBindVertexArray(position_vertex_array_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), nullptr);
+
+  glBindBuffer(GL_ARRAY_BUFFER, draw_index_buffer_);
+  glEnableVertexAttribArray(kDrawIndexLocation);
+  glVertexAttribIPointer(kDrawIndexLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+  glVertexAttribDivisor(kDrawIndexLocation, 1);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GeometryBuffer::~GeometryBuffer() {
+  glDeleteVertexArrays(1, &vertex_array_);
+  glDeleteVertexArrays(1, &position_vertex_array_);
+  glDeleteBuffers(1, &vertex_buffer_);
+  glDeleteBuffers(1, &index_buffer_);
+  glDeleteBuffers(1, &draw_index_buffer_);
+}
+
+GeometryBuffer::Range GeometryBuffer::Add(const Mesh &mesh) {
+  const auto [range, inserted] = ranges_.try_emplace(&mesh);
+  if (inserted) {
+    range->second = Range{
+        static_cast<GLint>(staged_vertices_.size()),
+        static_cast<GLuint>(staged_indices_.size()),
+        static_cast<GLsizei>(mesh.indices.size()),
+        static_cast<uint32_t>(ranges_.size() - 1)
+    };
+    staged_vertices_.insert(staged_vertices_.end(), mesh.vertices.begin(), mesh.vertices.end());
+    staged_indices_.insert(staged_indices_.end(), mesh.indices.begin(), mesh.indices.end());
+  }
+  return range->second;
+}
+
+void GeometryBuffer::Upload(size_t max_draws) {
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glBufferData(
+      GL_ARRAY_BUFFER,
+      static_cast<GLsizeiptr>(staged_vertices_.size() * sizeof(Mesh::Vertex)),
+      staged_vertices_.data(),
+      GL_STATIC_DRAW
+  );
+
+  std::vector<GLuint> draw_indices(max_draws);
+  std::iota(draw_indices.begin(), draw_indices.end(), 0U);
+  glBindBuffer(GL_ARRAY_BUFFER, draw_index_buffer_);
+  glBufferData(
+      GL_ARRAY_BUFFER,
+      static_cast<GLsizeiptr>(draw_indices.size() * sizeof(GLuint)),
+      draw_indices.data(),
+      GL_STATIC_DRAW
+  );
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // The element array binding is vertex array state.
+  glBindVertexArray(vertex_array_);
+  glBufferData(
+      GL_ELEMENT_ARRAY_BUFFER,
+      static_cast<GLsizeiptr>(staged_indices_.size() * sizeof(GLuint)),
+      staged_indices_.data(),
+      GL_STATIC_DRAW
+  );
+  glBindVertexArray(0);
+
+  staged_vertices_ = {};
+  staged_indices_ = {};
+}
+
+void GeometryBuffer::Clear() {
+  staged_vertices_.clear();
+  staged_indices_.clear();
+  ranges_.clear();
+}
+
+}  // namespace chove::rendering::opengl
@@ -0,0 +1,93 @@
+#include "rendering/opengl/program_reflection.h"
+
+#include <format>
+#include <vector>
+
+namespace chove::rendering::opengl {
+
+namespace {
+bool IsSampler(GLenum type) {
+  switch (type) {
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_CUBE_MAP_ARRAY:
+    case GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW:
+      return true;
+    default:
+      return false;
+  }
+}
+}  // namespace
+
+ProgramReflection::ProgramReflection(GLuint program) {
+  GLint uniform_count = 0;
+  GLint max_name_length = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniform_count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+  // Sampler units are program state, so the program has to be current while they are assigned.
+  GLint previous_program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+  glUseProgram(program);
+
+  std::vector<GLchar> name_buffer(max_name_length);
+  int next_unit = 0;
+  for (GLuint index = 0; index < static_cast<GLuint>(uniform_count); ++index) {
+    GLint size = 0;
+    GLenum type = 0;
+    GLsizei name_length = 0;
+    glGetActiveUniform(program, index, max_name_length, &name_length, &size, &type, name_buffer.data());
+    std::string name(name_buffer.data(), name_length);
+
+    // Uniforms in blocks have no location.
+    const GLint location = glGetUniformLocation(program, name.c_str());
+    if (location == -1) {
+      continue;
+    }
+
+    if (name.ends_with("[0]")) {
+      name.resize(name.size() - 3);
+      for (int element = 0; element < size; ++element) {
+        const std::string element_name = std::format("{}[{}]", name, element);
+        locations_[element_name] = location + element;
+        if (IsSampler(type)) {
+          sampler_units_[element_name] = next_unit + element;
+        }
+      }
+      locations_[name] = location;
+    }
+    else {
+      locations_[name] = location;
+      if (IsSampler(type)) {
+        sampler_units_[name] = next_unit;
+      }
+    }
+
+    if (IsSampler(type)) {
+      std::vector<GLint> units(size);
+      for (int element = 0; element < size; ++element) {
+        units[element] = next_unit++;
+      }
+      glUniform1iv(location, size, units.data());
+    }
+  }
+  sampler_unit_count_ = next_unit;
+
+  glUseProgram(previous_program);
+}
+
+GLint ProgramReflection::Location(std::string_view name) const {
+  const auto location = locations_.find(name);
+  return location == locations_.end() ? -1 : location->second;
+}
+
+int ProgramReflection::SamplerUnit(std::string_view name) const {
+  const auto unit = sampler_units_.find(name);
+  return unit == sampler_units_.end() ? -1 : unit->second;
+}
+
+}  // namespace chove::rendering::opengl
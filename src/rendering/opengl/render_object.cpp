@@ -2,46 +2,38 @@
 
 namespace chove::rendering::opengl {
 
-RenderObject::RenderObject(RenderObject &&other) noexcept: model(other.model),
-                                                           shadow_model(other.shadow_model),
-                                                           normal_matrix(other.normal_matrix),
-                                                           object_index(other.object_index),
+RenderObject::RenderObject(RenderObject &&other) noexcept: object_index(other.object_index),
                                                            shader_index(other.shader_index),
-                                                           vao(other.vao),
-                                                           vbo(other.vbo),
-                                                           ebo(other.ebo),
-                                                           dist(other.dist),
+                                                           geometry(other.geometry),
+                                                           material_index(other.material_index),
+                                                           material_data_index(other.material_data_index),
+                                                           cull_index(other.cull_index),
+                                                           static_model(other.static_model),
+                                                           dynamic_caster(other.dynamic_caster),
+                                                           transparent(other.transparent),
                                                            textures(std::move(other.textures)),
-                                                           material_data(std::move(other.material_data)) {
-  other.vao = 0;
-  other.vbo = 0;
-  other.ebo = 0;
-}
+                                                           texture_layers(std::move(other.texture_layers)),
+                                                           texture_units(std::move(other.texture_units)),
+                                                           texture_layer_units(std::move(other.texture_layer_units)),
+                                                           shadow_alpha_texture(other.shadow_alpha_texture),
+                                                           shader_ready(other.shader_ready) {}
 
 RenderObject &RenderObject::operator=(RenderObject &&other) noexcept {
-  model = other.model;
-  normal_matrix = other.normal_matrix;
-  shadow_model = other.shadow_model;
   object_index = other.object_index;
   shader_index = other.shader_index;
-  vao = other.vao;
-  vbo = other.vbo;
-  ebo = other.ebo;
+  geometry = other.geometry;
   textures = std::move(other.textures);
-  material_data = std::move(other.material_data);
-  dist = other.dist;
-
-  other.vao = 0;
-  other.vbo = 0;
-  other.ebo = 0;
+  texture_layers = std::move(other.texture_layers);
+  texture_units = std::move(other.texture_units);
+  texture_layer_units = std::move(other.texture_layer_units);
+  shadow_alpha_texture = other.shadow_alpha_texture;
+  material_index = other.material_index;
+  material_data_index = other.material_data_index;
+  cull_index = other.cull_index;
+  static_model = other.static_model;
+  dynamic_caster = other.dynamic_caster;
+  transparent = other.transparent;
+  shader_ready = other.shader_ready;
   return *this;
 }
-
-RenderObject::~RenderObject() {
-  if (vao != 0) {
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
-    glDeleteBuffers(1, &ebo);
-  }
-}
 }
@@ -2,17 +2,28 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <format>
+#include <functional>
 #include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <limits>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "glm/ext/matrix_clip_space.hpp"
 #include "glm/ext/matrix_transform.hpp"
@@ -22,14 +33,23 @@
 #include "objects/game_object.h"
 #include "objects/lights.h"
 #include "objects/scene.h"
+#include "rendering/frustum_culler.h"
 #include "rendering/material.h"
 #include "rendering/mesh.h"
+#include "rendering/occlusion_culler.h"
+#include "rendering/opengl/draw_list.h"
+#include "rendering/opengl/frame_ring_buffer.h"
+#include "rendering/opengl/geometry_buffer.h"
+#include "rendering/opengl/program_reflection.h"
 #include "rendering/opengl/render_object.h"
 #include "rendering/opengl/shader.h"
 #include "rendering/opengl/shader_allocator.h"
 #include "rendering/opengl/shader_flags.h"
+#include "rendering/opengl/shadow_atlas.h"
+#include "rendering/opengl/shadow_scheduler.h"
 #include "rendering/opengl/texture.h"
 #include "rendering/opengl/texture_allocator.h"
+#include "rendering/opengl/texture_array_packer.h"
 #include "rendering/opengl/uniform.h"
 #include "windowing/window.h"
 
@@ -158,24 +178,48 @@ void GLAPIENTRY MessageCallback(
 struct MatricesUBOData {
   [[maybe_unused]] alignas(16) glm::mat4 view;
   [[maybe_unused]] alignas(16) glm::mat4 projection;
+  // Computed once here, so that every program transforms positions the same way and depths match exactly.
+  [[maybe_unused]] alignas(16) glm::mat4 view_projection;
 };
 
-struct MaterialUBOData {
-  [[maybe_unused]] float shininess;
-  [[maybe_unused]] float opticalDensity;
-  [[maybe_unused]] float dissolve;
-  [[maybe_unused]] alignas(16) glm::vec3 diffuseColor;
-  [[maybe_unused]] alignas(16) glm::vec3 ambientColor;
-  [[maybe_unused]] alignas(16) glm::vec3 specularColor;
-  [[maybe_unused]] alignas(16) glm::vec3 transmissionFilterColor;
-};
-
-constexpr int kMatricesUBOBindingPoint = 0;
-constexpr int kMaterialUBOBindingPoint = 1;
-constexpr int kLightsUBOBindingPoint = 2;
-constexpr int kLightSpaceMatricesUBOBindingPoint = 3;
+// Set in the shaders with layout qualifiers. Storage blocks have binding points of their own.
+constexpr GLuint kMatricesUBOBindingPoint = 0;
+constexpr GLuint kLightsUBOBindingPoint = 2;
+constexpr GLuint kDrawDataSSBOBindingPoint = 0;
+constexpr GLuint kMaterialsSSBOBindingPoint = 1;
+constexpr GLuint kPointLightsSSBOBindingPoint = 2;
+constexpr GLuint kSpotLightsSSBOBindingPoint = 3;
+constexpr GLuint kLightClustersSSBOBindingPoint = 4;
+constexpr GLuint kLightIndicesSSBOBindingPoint = 5;
+constexpr GLuint kLightSpacesSSBOBindingPoint = 6;
+
+// Frame buffer allocations Render makes besides the shadow passes: the matrices and lights uniform blocks, the point
+// light, spot light, light cluster, light index and light space storage blocks, the pre-pass instances and indirect
+// commands, and the main pass draw data and indirect commands. DrawShadowCasters adds one per call.
+constexpr size_t kFrameAllocationCount = 11;
+
+// Resolution of the depth buffer occluders are rasterized into, and the most threads rasterizing it.
+constexpr int kOcclusionBufferWidth = 256;
+constexpr int kOcclusionBufferHeight = 128;
+constexpr unsigned int kMaxOcclusionThreads = 4;
 
 constexpr int kShadowMapSize = 2048;
+// Point lights with shadows share one cube map array with a cube for each, the other point lights are unshadowed.
+constexpr int kMaxShadowedPointLights = 4;
+// Directional and spot light shadow maps share one atlas. The directional light gets a tile of kShadowMapSize, spot
+// lights start at half of it and settle for smaller tiles once the atlas fills up.
+constexpr int kShadowAtlasSize = 4096;
+constexpr int kMinShadowTileSize = 128;
+// How far from the camera directional shadows reach.
+constexpr float kDirectionalShadowDistance = 100.0F;
+// The directional light's tile is split in four quadrants, one cascade each. The far distance of every cascade fills
+// one component of the vec4 at the start of the light space storage block, DIRECTIONAL_CASCADE_COUNT in the shader.
+constexpr int kDirectionalCascadeCount = 4;
+// Blend between the logarithmic and the uniform split of the view distance, higher favours the logarithmic one.
+constexpr float kCascadeSplitLambda = 0.75F;
+// Cascade far distances, followed by the light space of every cascade and then of every spot light.
+constexpr size_t kLightSpacesOffset = sizeof(glm::vec4);
+static_assert(kDirectionalCascadeCount * sizeof(float) == kLightSpacesOffset);
 
 constexpr std::array<glm::vec3, 6> kCubeMapDirections = {
     glm::vec3(1.0F, 0.0F, 0.0F),
@@ -195,24 +239,172 @@ constexpr std::array<glm::vec3, 6> kCubeMapUpVectors = {
     glm::vec3(0.0F, -1.0F, 0.0F)
 };
 
+// Order of the textures in the material, matching the layout of the texture layers in the material uniform block.
+constexpr std::array<std::string_view, 7> kMaterialTextureNames = {
+    "ambientTexture",
+    "diffuseTexture",
+    "specularTexture",
+    "shininessTexture",
+    "alphaTexture",
+    "bumpTexture",
+    "displacementTexture"
+};
+
 auto GetRenderInfo(Scene *scene) { return scene->GetAllObjectsWith<RenderObject, Transform, Mesh *>(); }
 
-std::tuple<DirectionalLight, Texture &, GLuint> GetDirectionalLightInfo(Scene *scene) {
-  auto view = scene->GetAllObjectsWith<DirectionalLight, Texture, GLuint>();
+std::tuple<DirectionalLight, ShadowAtlas::Tile> GetDirectionalLightInfo(Scene *scene) {
+  auto view = scene->GetAllObjectsWith<DirectionalLight, ShadowAtlas::Tile>();
   DirectionalLight directional_light = view.get<DirectionalLight>(view.front());
-  Texture &depth_map = view.get<Texture>(view.front());
-  GLuint framebuffer = view.get<GLuint>(view.front());
+  ShadowAtlas::Tile tile = view.get<ShadowAtlas::Tile>(view.front());
+
+  return {directional_light, tile};
+}
+
+// Distance at which the attenuation of a light drops below what an 8-bit framebuffer can show.
+float AttenuationRange(float constant, float linear, float quadratic) {
+  constexpr float kMaxAttenuationFactor = 256.0F;
+  if (quadratic > 0.0F) {
+    return (-linear + std::sqrt(linear * linear - 4.0F * quadratic * (constant - kMaxAttenuationFactor))) /
+           (2.0F * quadratic);
+  }
+  if (linear > 0.0F) {
+    return (kMaxAttenuationFactor - constant) / linear;
+  }
+  return std::numeric_limits<float>::max();
+}
+
+// Objects beyond the reach of a light cast no visible shadow, even if they are inside its shadow map.
+float ShadowRange(const PointLight &light) {
+  return std::max(std::min(light.far_plane, AttenuationRange(light.constant, light.linear, light.quadratic)),
+                  light.near_plane);
+}
+
+float ShadowRange(const SpotLight &light) {
+  return std::max(std::min(10.0F, AttenuationRange(light.constant, light.linear, light.quadratic)), 0.1F);
+}
+
+// How much a light's shadows matter on screen: the share of the view its range covers, falling off with distance once
+// the camera is outside of it, and nothing when the range is entirely off screen.
+float ShadowImportance(const glm::vec3 &position, float range, const objects::Camera &camera, const Frustum &frustum) {
+  if (!frustum.IntersectsSphere(position, range)) {
+    return 0.0F;
+  }
+  return range / std::max(glm::distance(position, camera.position()), range);
+}
+
+// Far distance of every directional shadow cascade from the camera.
+std::array<float, kDirectionalCascadeCount> CascadeSplits(const objects::Camera &camera) {
+  const float near_plane = camera.near_plane();
+  const float far_plane = std::min(camera.far_plane(), kDirectionalShadowDistance);
+  std::array<float, kDirectionalCascadeCount> splits{};
+  for (int cascade = 0; cascade < kDirectionalCascadeCount; ++cascade) {
+    const float fraction = static_cast<float>(cascade + 1) / kDirectionalCascadeCount;
+    const float logarithmic_split = near_plane * std::pow(far_plane / near_plane, fraction);
+    const float uniform_split = near_plane + (far_plane - near_plane) * fraction;
+    splits.at(cascade) = kCascadeSplitLambda * logarithmic_split + (1.0F - kCascadeSplitLambda) * uniform_split;
+  }
+  return splits;
+}
+
+// Quadrant of the directional light's tile that holds a cascade.
+ShadowAtlas::Tile CascadeTile(const ShadowAtlas::Tile &tile, int cascade) {
+  const int size = tile.size / 2;
+  return {tile.x + (cascade & 1) * size, tile.y + (cascade >> 1) * size, size};
+}
 
-  return {directional_light, depth_map, framebuffer};
+// Orthographic light space matrices around consecutive slices of the camera frustum, ending at the given splits. Each
+// projection is square around the bounding sphere of its slice, so that its size does not change as the camera turns,
+// and moves in whole texels of the cascade tile, so that shadow edges do not shimmer as the camera moves. The near side
+// is pulled back towards the light far enough to take in every caster of the scene.
+std::array<glm::mat4, kDirectionalCascadeCount> FitDirectionalCascades(
+    const DirectionalLight &light,
+    const objects::Camera &camera,
+    const std::array<float, kDirectionalCascadeCount> &splits,
+    int cascade_tile_size,
+    const Mesh::BoundingBox &scene_bounds
+) {
+  const glm::vec3 light_direction = -glm::normalize(light.direction);
+  const glm::vec3 up = std::abs(light_direction.y) > 0.99F ? glm::vec3(0.0F, 0.0F, 1.0F) : glm::vec3(0.0F, 1.0F, 0.0F);
+  const glm::mat4 light_view = glm::lookAt(glm::vec3(0.0F), light_direction, up);
+  // The light looks down its negative z axis, so the casters closest to the light have the largest z.
+  const float casters_near_z = scene_bounds.min.x <= scene_bounds.max.x
+                                   ? scene_bounds.Transformed(light_view).max.z
+                                   : std::numeric_limits<float>::lowest();
+
+  std::array<glm::mat4, kDirectionalCascadeCount> matrices{};
+  float slice_near = camera.near_plane();
+  for (int cascade = 0; cascade < kDirectionalCascadeCount; ++cascade) {
+    const float slice_far = splits.at(cascade);
+    const glm::mat4 inverse_slice = glm::inverse(
+        glm::perspective(camera.fov(), camera.aspect_ratio(), slice_near, slice_far) * camera.GetViewMatrix()
+    );
+    std::array<glm::vec3, 8> corners{};
+    glm::vec3 center{0.0F};
+    for (int corner = 0; corner < 8; ++corner) {
+      const glm::vec4 ndc_corner{corner & 1 ? 1.0F : -1.0F, corner & 2 ? 1.0F : -1.0F, corner & 4 ? 1.0F : -1.0F, 1.0F};
+      const glm::vec4 world_corner = inverse_slice * ndc_corner;
+      corners.at(corner) = glm::vec3(world_corner / world_corner.w);
+      center += corners.at(corner) / 8.0F;
+    }
+    float radius = 0.0F;
+    for (const glm::vec3 &corner : corners) {
+      radius = std::max(radius, glm::distance(corner, center));
+    }
+    // Rounded up so that float noise does not change the texel size from one frame to the next.
+    radius = std::ceil(radius * 16.0F) / 16.0F;
+
+    glm::vec3 light_center = glm::vec3(light_view * glm::vec4(center, 1.0F));
+    const float texel_size = 2.0F * radius / static_cast<float>(cascade_tile_size);
+    light_center.x = std::floor(light_center.x / texel_size) * texel_size;
+    light_center.y = std::floor(light_center.y / texel_size) * texel_size;
+
+    const float near_z = std::max(light_center.z + radius, casters_near_z);
+    matrices.at(cascade) = glm::ortho(
+                               light_center.x - radius,
+                               light_center.x + radius,
+                               light_center.y - radius,
+                               light_center.y + radius,
+                               -near_z,
+                               -(light_center.z - radius)
+                           ) *
+                           light_view;
+    slice_near = slice_far;
+  }
+  return matrices;
 }
 
 auto GetPointLightsInfo(Scene *scene) { return scene->GetAllObjectsWith<PointLight, Texture, GLuint>(); }
 
-auto GetSpotLightsInfo(Scene *scene) { return scene->GetAllObjectsWith<SpotLight, Texture, GLuint>(); }
+// Start of the light clusters storage block, followed by the range of every cluster.
+struct LightClustersHeader {
+  [[maybe_unused]] glm::uvec4 cluster_counts;
+  [[maybe_unused]] glm::vec4 params;
+};
+
+// The directional light's uniform block, the point and spot light storage blocks and the light grid's clusters, sized
+// for every light reaching every cluster.
+size_t LightsSize(Scene *scene) {
+  const size_t point_light_count = scene->GetAllObjectsWith<PointLight>().size();
+  const size_t spot_light_count = scene->GetAllObjectsWith<SpotLight>().size();
+  return sizeof(DirectionalLight) + point_light_count * sizeof(PointLight) + spot_light_count * sizeof(SpotLight) +
+      sizeof(LightClustersHeader) + LightGrid::kClusterCount * sizeof(LightGrid::Range) +
+      std::max<size_t>(LightGrid::kClusterCount * (point_light_count + spot_light_count), 1) * sizeof(uint32_t);
+}
+
+// Renders into a tile only, glClear included.
+void SetShadowTile(const ShadowAtlas::Tile &tile) {
+  glViewport(tile.x, tile.y, tile.size, tile.size);
+  glScissor(tile.x, tile.y, tile.size, tile.size);
+}
 
 }  // namespace
 
-Renderer::Renderer(const Window *window) : window_(window), scene_(nullptr) {
+Renderer::Renderer(const Window *window, RendererSettings settings) :
+    window_(window),
+    scene_(nullptr),
+    settings_(settings),
+    shadow_scheduler_(settings.shadow_face_updates_per_frame),
+    shadow_atlas_(kShadowAtlasSize) {
   glewExperimental = GL_TRUE;
   glewInit();
 
@@ -232,8 +424,14 @@ Renderer::Renderer(const Window *window) : window_(window), scene_(nullptr) {
   glEnable(GL_DEBUG_OUTPUT);
   glDebugMessageCallback(MessageCallback, nullptr);
 
-  texture_allocator_ = std::make_unique<TextureAllocator>();
-  shader_allocator_ = std::make_unique<ShaderAllocator>();
+  texture_allocator_ = std::make_unique<TextureAllocator>(
+      settings_.texture_memory_budget, settings_.compress_textures
+  );
+  texture_streamer_ = std::make_unique<TextureStreamer>(
+      *texture_allocator_, settings_.texture_memory_budget, settings_.texture_mip_uploads_per_frame
+  );
+  texture_array_packer_ = std::make_unique<TextureArrayPacker>(*texture_allocator_);
+  shader_allocator_ = std::make_unique<ShaderAllocator>(settings_.shader_cache_directory);
 
   depth_map_shader_ = std::make_unique<Shader>(
       "shaders/depth_map.vert",
@@ -243,122 +441,595 @@ Renderer::Renderer(const Window *window) : window_(window), scene_(nullptr) {
       *shader_allocator_
   );
 
+  // Everything else waits on these, so they are the only programs whose compilation blocks.
+  shader_allocator_->WaitUntilReady(depth_map_shader_->program());
+  const ProgramReflection depth_map_reflection(depth_map_shader_->program());
+  depth_map_dissolve_location_ = depth_map_reflection.Location("dissolve");
+  depth_map_light_space_matrix_location_ = depth_map_reflection.Location("lightSpaceMatrix");
+  depth_map_alpha_unit_ = depth_map_reflection.SamplerUnit("alphaTexture");
+  cube_depth_map_shader_ = std::make_unique<Shader>(
+      "shaders/depth_map_cube.vert",
+      std::vector<ShaderFlag>{},
+      "shaders/depth_map.frag",
+      std::vector<ShaderFlag>{},
+      "shaders/depth_map_cube.geom",
+      std::vector<ShaderFlag>{},
+      *shader_allocator_
+  );
+  shader_allocator_->WaitUntilReady(cube_depth_map_shader_->program());
+  const ProgramReflection cube_depth_map_reflection(cube_depth_map_shader_->program());
+  cube_depth_map_dissolve_location_ = cube_depth_map_reflection.Location("dissolve");
+  cube_depth_map_face_matrices_location_ = cube_depth_map_reflection.Location("faceMatrices[0]");
+  cube_depth_map_alpha_unit_ = cube_depth_map_reflection.SamplerUnit("alphaTexture");
+  fallback_shader_ = std::make_unique<Shader>(
+      "shaders/fallback.vert",
+      std::vector<ShaderFlag>{},
+      "shaders/fallback.frag",
+      std::vector<ShaderFlag>{},
+      *shader_allocator_
+  );
+  shader_allocator_->WaitUntilReady(fallback_shader_->program());
+  fallback_model_location_ = glGetUniformLocation(fallback_shader_->program(), "model");
+  fallback_color_location_ = glGetUniformLocation(fallback_shader_->program(), "color");
+
   white_pixel_ = std::make_unique<Texture>(
       std::filesystem::current_path() / "models" / "textures" / "white_pixel.png", "whitePixel", *texture_allocator_
   );
+
+  geometry_buffer_ = std::make_unique<GeometryBuffer>();
+  frame_buffer_ = std::make_unique<FrameRingBuffer>();
+  if (settings_.occlusion_culling) {
+    occlusion_culler_ = std::make_unique<OcclusionCuller>(
+        kOcclusionBufferWidth,
+        kOcclusionBufferHeight,
+        static_cast<int>(std::clamp(std::thread::hardware_concurrency(), 1U, kMaxOcclusionThreads))
+    );
+  }
+  glGenBuffers(1, &material_buffer_);
+  for (FragmentQueries &queries : fragment_queries_) {
+    glGenQueries(1, &queries.prepass);
+    glGenQueries(1, &queries.shaded);
+  }
+
+  shadow_atlas_texture_ =
+      std::make_unique<Texture>(kShadowAtlasSize, kShadowAtlasSize, "shadowAtlas", *texture_allocator_);
+  glGenFramebuffers(1, &shadow_atlas_framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, shadow_atlas_framebuffer_);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadow_atlas_texture_->texture(), 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::BuildDrawList() {
+  draw_list_.Clear();
+  frustum_culler_.Clear();
+  culled_entities_.clear();
+  culled_bounds_.clear();
+  auto view = GetRenderInfo(scene_);
+  scene_bounds_ = Mesh::BoundingBox{
+      .min = glm::vec3(std::numeric_limits<float>::max()), .max = glm::vec3(std::numeric_limits<float>::lowest())
+  };
+  dynamic_caster_count_ = 0;
+  for (auto &&[entity, render_info, transform, mesh] : view.each()) {
+    const glm::mat4 model_matrix = transform.GetMatrix();
+    // An object is static until its transform changes for the first time, the cached shadows it was part of are stale
+    // from then on.
+    if (!render_info.dynamic_caster && model_matrix != render_info.static_model) {
+      render_info.dynamic_caster = true;
+      static_shadows_stale_ = true;
+    }
+    if (render_info.dynamic_caster) {
+      dynamic_caster_count_++;
+    }
+    const Mesh::BoundingBox world_bounds = mesh->bounding_box.Transformed(model_matrix);
+    scene_bounds_.min = glm::min(scene_bounds_.min, world_bounds.min);
+    scene_bounds_.max = glm::max(scene_bounds_.max, world_bounds.max);
+    render_info.cull_index = static_cast<uint32_t>(frustum_culler_.size());
+    frustum_culler_.Add(world_bounds);
+    culled_entities_.push_back(entity);
+    culled_bounds_.push_back(world_bounds);
+  }
+
+  const objects::Camera &camera = scene_->camera();
+  const glm::mat4 view_projection = camera.GetProjectionMatrix() * camera.GetViewMatrix();
+  frustum_culler_.Cull(Frustum::FromMatrix(view_projection), visible_objects_);
+  if (occlusion_culler_ != nullptr) {
+    CullOccludedObjects(view_projection);
+  }
+  object_visible_.assign(frustum_culler_.size(), 0);
+  for (const uint32_t visible_object : visible_objects_) {
+    object_visible_[visible_object] = 1;
+  }
+
+  // Shadow casters are culled per shadow view in RenderDepthMap.
+  draw_list_.Append(static_draws_.Pass(DrawPass::kShadow));
+  for (const DrawList::Command &command : static_draws_.Pass(DrawPass::kMain)) {
+    if (object_visible_[view.get<RenderObject>(command.entity).cull_index] != 0) {
+      draw_list_.Add(command.key, command.entity);
+    }
+  }
+
+  // Invisible transparent objects are re-keyed as well, so that they are in order once they come into view.
+  for (DrawList::Command &command : transparent_draws_) {
+    auto [render_info, transform, mesh] = view.get<RenderObject, Transform, Mesh *>(command.entity);
+    const float distance = glm::distance2(camera.position(), transform.location + mesh->bounding_box.center());
+    command.key = DrawList::TransparentKey(
+        DrawPass::kMain, distance, static_cast<uint32_t>(render_info.shader_index), render_info.material_index
+    );
+  }
+  DrawList::SortNearlySorted(transparent_draws_);
+  for (const DrawList::Command &command : transparent_draws_) {
+    if (object_visible_[view.get<RenderObject>(command.entity).cull_index] != 0) {
+      draw_list_.Add(command.key, command.entity);
+    }
+  }
 }
 
-void Renderer::RenderDepthMap() {
-  for (auto &&[_, render_info, transform, mesh] : GetRenderInfo(scene_).each()) {
-    render_info.shadow_model.UpdateValue(transform.GetMatrix());
-    glUniform1f(glGetUniformLocation(depth_map_shader_->program(), "dissolve"), mesh->material.dissolve);
+void Renderer::CullOccludedObjects(const glm::mat4 &view_projection) {
+  auto view = GetRenderInfo(scene_);
+  occlusion_culler_->Begin(view_projection);
+  auto triangle_budget = static_cast<size_t>(std::max(settings_.occluder_triangle_budget, 0));
+  for (auto &&[_, proxy, transform] : scene_->GetAllObjectsWith<OccluderProxy, Transform>().each()) {
+    if (proxy.indices.size() / 3 > triangle_budget) {
+      continue;
+    }
+    triangle_budget -= proxy.indices.size() / 3;
+    occlusion_culler_->AddOccluder(transform.GetMatrix(), proxy.positions, proxy.indices);
+  }
 
-    // find alphaTexture in textures
-    auto alphaTexture =
-        std::find_if(render_info.textures.begin(), render_info.textures.end(), [](const Texture &texture) {
-          return texture.name() == "alphaTexture";
-        });
-    if (alphaTexture == render_info.textures.end()) {
-      glBindTexture(GL_TEXTURE_2D, white_pixel_->texture());
+  // Objects are scored by the squared ratio of their bounding sphere's radius to its distance, close to their share of
+  // the screen, and the largest ones that fit in the budget occlude.
+  occluder_candidates_.clear();
+  const glm::vec3 &camera_position = scene_->camera().position();
+  for (const uint32_t object : visible_objects_) {
+    const entt::entity entity = culled_entities_[object];
+    if (view.get<RenderObject>(entity).transparent || scene_->registry().all_of<OccluderProxy>(entity)) {
+      continue;
+    }
+    const Mesh::BoundingBox &bounds = culled_bounds_[object];
+    const float squared_radius = glm::distance2(bounds.min, bounds.max) / 4.0F;
+    const float squared_distance = glm::distance2(camera_position, bounds.center());
+    occluder_candidates_.emplace_back(squared_radius / std::max(squared_distance, squared_radius), object);
+  }
+  std::ranges::sort(occluder_candidates_, std::ranges::greater{});
+  for (const auto &[_, object] : occluder_candidates_) {
+    auto [transform, mesh] = view.get<Transform, Mesh *>(culled_entities_[object]);
+    if (mesh->indices.size() / 3 > triangle_budget) {
+      continue;
+    }
+    triangle_budget -= mesh->indices.size() / 3;
+    occlusion_culler_->AddOccluder(transform.GetMatrix(), mesh->vertices, mesh->indices);
+  }
+  occlusion_culler_->Rasterize();
+
+  const size_t visible_count = visible_objects_.size();
+  std::erase_if(visible_objects_, [&](const uint32_t object) {
+    return !occlusion_culler_->IsVisible(culled_bounds_[object]);
+  });
+  frame_stats_.occlusion_culled = static_cast<int>(visible_count - visible_objects_.size());
+  frame_stats_.occluder_triangles = static_cast<int>(occlusion_culler_->triangle_count());
+}
+
+void Renderer::SortStaticDraws() {
+  static_draws_.Clear();
+  transparent_draws_.clear();
+  for (auto &&[entity, render_info] : scene_->GetAllObjectsWith<RenderObject>().each()) {
+    static_draws_.Add(
+        DrawList::OpaqueKey(DrawPass::kShadow, 0, render_info.shadow_alpha_texture, render_info.geometry.mesh), entity
+    );
+    if (render_info.transparent) {
+      transparent_draws_.push_back(DrawList::Command{0, entity});
     }
     else {
-      glBindTexture(GL_TEXTURE_2D, alphaTexture->texture());
+      static_draws_.Add(
+          DrawList::OpaqueKey(
+              DrawPass::kMain,
+              static_cast<uint32_t>(render_info.shader_index),
+              render_info.material_index,
+              render_info.geometry.mesh
+          ),
+          entity
+      );
+    }
+  }
+  static_draws_.Sort();
+}
+
+void Renderer::RenderDepthMap(
+    const glm::mat4 &light_space_matrix, const glm::mat4 &culling_matrix, const bool dynamic_casters
+) {
+  glUniformMatrix4fv(depth_map_light_space_matrix_location_, 1, GL_FALSE, glm::value_ptr(light_space_matrix));
+
+  frustum_culler_.Cull(Frustum::FromMatrix(culling_matrix), shadow_casters_);
+  shadow_caster_faces_.assign(frustum_culler_.size(), 0);
+  for (const uint32_t caster : shadow_casters_) {
+    shadow_caster_faces_[caster] = 1;
+  }
+
+  DrawShadowCasters(dynamic_casters, depth_map_dissolve_location_, depth_map_alpha_unit_);
+}
+
+void Renderer::RenderCubeDepthMap(
+    const std::array<glm::mat4, 6> &face_matrices,
+    const std::array<glm::mat4, 6> &culling_matrices,
+    const bool dynamic_casters
+) {
+  glUniformMatrix4fv(cube_depth_map_face_matrices_location_, 6, GL_FALSE, glm::value_ptr(face_matrices.front()));
+
+  shadow_caster_faces_.assign(frustum_culler_.size(), 0);
+  for (int face = 0; face < 6; ++face) {
+    frustum_culler_.Cull(Frustum::FromMatrix(culling_matrices.at(face)), shadow_casters_);
+    for (const uint32_t caster : shadow_casters_) {
+      shadow_caster_faces_[caster] |= 1 << face;
+    }
+  }
+
+  // Each caster is drawn once, the geometry shader sends its triangles to the faces in the mask.
+  DrawShadowCasters(dynamic_casters, cube_depth_map_dissolve_location_, cube_depth_map_alpha_unit_);
+}
+
+void Renderer::DrawShadowCasters(const bool dynamic_casters, const GLint dissolve_location, const int alpha_unit) {
+  auto view = GetRenderInfo(scene_);
+  shadow_instances_.clear();
+  for (const DrawList::Command &command : draw_list_.Pass(DrawPass::kShadow)) {
+    const RenderObject &render_info = view.get<RenderObject>(command.entity);
+    if (shadow_caster_faces_[render_info.cull_index] != 0 && render_info.dynamic_caster == dynamic_casters) {
+      shadow_instances_.push_back(command.entity);
     }
+  }
 
-    glBindVertexArray(render_info.vao);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh->indices.size()), GL_UNSIGNED_INT, nullptr);
-    glBindVertexArray(0);
+  const FrameRingBuffer::Allocation instances =
+      frame_buffer_->Allocate(shadow_instances_.size() * sizeof(ShadowInstance));
+  for (size_t i = 0; i < shadow_instances_.size(); ++i) {
+    auto [render_info, transform] = view.get<RenderObject, Transform>(shadow_instances_[i]);
+    const ShadowInstance instance{transform.GetMatrix(), shadow_caster_faces_[render_info.cull_index]};
+    std::memcpy(instances.data + i * sizeof(ShadowInstance), &instance, sizeof(ShadowInstance));
+  }
+  frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kDrawDataSSBOBindingPoint, instances);
+
+  // The shadow pass is sorted by alpha texture and mesh, and objects of one mesh share its material, so every run of
+  // casters of one mesh is a single instanced draw.
+  for (size_t first = 0; first < shadow_instances_.size();) {
+    auto [render_info, mesh] = view.get<RenderObject, Mesh *>(shadow_instances_[first]);
+    size_t last = first + 1;
+    while (last < shadow_instances_.size() &&
+           view.get<RenderObject>(shadow_instances_[last]).geometry.mesh == render_info.geometry.mesh) {
+      last++;
+    }
+    glUniform1f(dissolve_location, mesh->material.dissolve);
+    BindTexture(alpha_unit, GL_TEXTURE_2D, render_info.shadow_alpha_texture);
+    DrawGeometry(render_info.geometry, static_cast<GLuint>(first), static_cast<GLsizei>(last - first));
+    first = last;
   }
 }
 
+void Renderer::ScheduleShadowUpdates() {
+  // Caches of lights skipped this frame must still be rebuilt once they are updated.
+  if (static_shadows_stale_) {
+    for (auto &&[_, cache] : scene_->GetAllObjectsWith<StaticShadowCache>().each()) {
+      cache.valid = false;
+    }
+    static_shadows_stale_ = false;
+  }
+
+  const objects::Camera &camera = scene_->camera();
+  const Frustum frustum = Frustum::FromMatrix(camera.GetProjectionMatrix() * camera.GetViewMatrix());
+  for (auto &&[object, point_light, depth_map, framebuffer] : GetPointLightsInfo(scene_).each()) {
+    const float importance = ShadowImportance(point_light.position, ShadowRange(point_light), camera, frustum);
+    shadow_scheduler_.Request(object, importance, 6);
+  }
+  // The directional light shades the whole view.
+  for (auto &&[object, _] : scene_->GetAllObjectsWith<DirectionalLight>().each()) {
+    shadow_scheduler_.Request(object, 1.0F, kDirectionalCascadeCount);
+  }
+  for (auto &&[object, spot_light, _] : scene_->GetAllObjectsWith<SpotLight, ShadowAtlas::Tile>().each()) {
+    const float importance = ShadowImportance(spot_light.position, ShadowRange(spot_light), camera, frustum);
+    shadow_scheduler_.Request(object, importance, 1);
+  }
+  shadow_scheduler_.Schedule();
+
+  frame_stats_.shadow_map_updates = shadow_scheduler_.scheduled_count();
+  frame_stats_.max_shadow_staleness = static_cast<int>(shadow_scheduler_.max_staleness());
+  LOG_EVERY_N_SEC(INFO, 10) << "Shadow map staleness in frames: " << ShadowStalenessReport();
+}
+
+std::string Renderer::ShadowStalenessReport() const {
+  std::string report;
+  const auto append = [&](std::string_view kind, entt::entity light) {
+    const uint64_t staleness = shadow_scheduler_.Staleness(light);
+    report += std::format(
+        "{}{} {}: {}",
+        report.empty() ? "" : ", ",
+        kind,
+        static_cast<uint32_t>(light),
+        staleness == std::numeric_limits<uint64_t>::max() ? std::string("never rendered") : std::to_string(staleness)
+    );
+  };
+  for (auto &&[object, _] : scene_->GetAllObjectsWith<DirectionalLight>().each()) {
+    append("directional light", object);
+  }
+  for (auto &&[object, point_light, depth_map, framebuffer] : GetPointLightsInfo(scene_).each()) {
+    append("point light", object);
+  }
+  for (auto &&[object, spot_light, tile] : scene_->GetAllObjectsWith<SpotLight, ShadowAtlas::Tile>().each()) {
+    append("spot light", object);
+  }
+  return report;
+}
+
+void Renderer::UpdateShadowMap(
+    StaticShadowCache &cache,
+    const Texture &depth_map,
+    const GLenum target,
+    const ShadowAtlas::Tile &region,
+    const std::span<const glm::mat4> matrices,
+    const std::function<void(bool dynamic_casters)> &draw_casters
+) {
+  const GLsizei layers = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+  if (!cache.valid || !std::ranges::equal(matrices, cache.matrices)) {
+    glClear(GL_DEPTH_BUFFER_BIT);
+    draw_casters(false);
+    glCopyImageSubData(depth_map.texture(), target, 0, region.x, region.y, 0,
+                       cache.static_depth.texture(), target, 0, 0, 0, 0,
+                       region.size, region.size, layers);
+    cache.matrices.assign(matrices.begin(), matrices.end());
+    cache.valid = true;
+  }
+  else if (cache.holds_dynamic_casters) {
+    // Otherwise the shadow map still holds exactly the static depth from the previous frame.
+    glCopyImageSubData(cache.static_depth.texture(), target, 0, 0, 0, 0,
+                       depth_map.texture(), target, 0, region.x, region.y, 0,
+                       region.size, region.size, layers);
+  }
+
+  cache.holds_dynamic_casters = dynamic_caster_count_ > 0;
+  if (cache.holds_dynamic_casters) {
+    draw_casters(true);
+  }
+}
+
+void Renderer::BindTexture(int unit, GLenum target, GLuint texture) {
+  size_t target_index = 0;
+  switch (target) {
+    case GL_TEXTURE_2D:
+      target_index = 0;
+      break;
+    case GL_TEXTURE_2D_ARRAY:
+      target_index = 1;
+      break;
+    case GL_TEXTURE_CUBE_MAP_ARRAY:
+      target_index = 2;
+      break;
+    default:
+      LOG(FATAL) << "Unsupported texture target " << target;
+  }
+  GLuint &bound_texture = bound_textures_.at(unit).at(target_index);
+  if (bound_texture == texture) {
+    return;
+  }
+  // Bindings are reset every frame, so every texture sampled in a frame is stamped at least once, and evicted ones are
+  // restored before the draw samples them.
+  texture_allocator_->MarkUsed(texture, frame_index_);
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(target, texture);
+  bound_texture = texture;
+  frame_stats_.texture_binds++;
+}
+
+void Renderer::BindVertexArray(GLuint vertex_array) {
+  if (bound_vertex_array_ == vertex_array) {
+    return;
+  }
+  glBindVertexArray(vertex_array);
+  bound_vertex_array_ = vertex_array;
+  frame_stats_.vertex_array_binds++;
+}
+
+void Renderer::UseProgram(GLuint program) {
+  if (bound_program_ == program) {
+    return;
+  }
+  glUseProgram(program);
+  bound_program_ = program;
+  frame_stats_.program_binds++;
+}
+
+void Renderer::PackMaterialTextures() {
+  for (auto &&[_, render_info] : scene_->GetAllObjectsWith<RenderObject>().each()) {
+    for (const Texture &texture : render_info.textures) {
+      // The depth map shader samples alpha textures as plain 2D textures, so they are left out of the arrays.
+      if (texture.name() != "alphaTexture") {
+        texture_array_packer_->AddTexture(texture.texture());
+      }
+    }
+  }
+  texture_array_packer_->Pack();
+
+  for (auto &&[_, render_info] : scene_->GetAllObjectsWith<RenderObject>().each()) {
+    std::vector<Texture> unpacked_textures;
+    for (Texture &texture : render_info.textures) {
+      if (texture.name() == "alphaTexture") {
+        unpacked_textures.push_back(std::move(texture));
+        continue;
+      }
+      const auto slot = std::ranges::find(kMaterialTextureNames, texture.name()) - kMaterialTextureNames.begin();
+      const TextureArrayPacker::Layer layer = texture_array_packer_->GetLayer(texture.texture());
+      render_info.texture_layers.push_back(
+          TextureLayer{texture.name(), layer.texture_array, layer.layer, static_cast<int>(slot)}
+      );
+    }
+    // Dropping the standalone textures lets the allocator release them, the arrays hold their own copy.
+    render_info.textures = std::move(unpacked_textures);
+  }
+}
+
+void Renderer::StreamTextures() {
+  const objects::Camera &camera = scene_->camera();
+  // Pixels covered by one unit of length at unit distance from the camera.
+  const float pixels_per_unit = static_cast<float>(window_->extent().height) / (2.0F * std::tan(camera.fov() / 2.0F));
+
+  // Only objects in view ask for detail, the others fall back to idle levels or stay evicted.
+  auto view = GetRenderInfo(scene_);
+  for (const uint32_t visible_object : visible_objects_) {
+    auto [render_info, transform, mesh] = view.get<RenderObject, Transform, Mesh *>(culled_entities_[visible_object]);
+    if (render_info.textures.empty() || mesh->texcoord_density <= 0.0F) {
+      continue;
+    }
+
+    const glm::mat4 model_matrix = transform.GetMatrix();
+    const Mesh::BoundingBox &world_bounds = culled_bounds_[visible_object];
+    const glm::vec3 closest_point = glm::clamp(camera.position(), world_bounds.min, world_bounds.max);
+    const float distance = std::max(glm::distance(camera.position(), closest_point), camera.near_plane());
+    const float scale = std::max(
+        {glm::length(glm::vec3(model_matrix[0])),
+         glm::length(glm::vec3(model_matrix[1])),
+         glm::length(glm::vec3(model_matrix[2]))}
+    );
+    const float pixels_per_texcoord = pixels_per_unit * scale / (distance * mesh->texcoord_density);
+
+    for (const Texture &texture : render_info.textures) {
+      texture_streamer_->RequestTexture(texture.texture(), pixels_per_texcoord);
+    }
+  }
+
+  texture_streamer_->Update();
+}
+
 void Renderer::Render() {
   if (scene_ == nullptr) return;
+  // A minimized window has no pixels to draw, nor screen tiles to cluster lights into.
+  if (window_->extent().width == 0 || window_->extent().height == 0) return;
 
   if (scene_->dirty_bit()) {
     SetupScene(*scene_);
   }
 
-  // Sort objects by distance to camera
-  GetRenderInfo(scene_).each([this](RenderObject &render_info, Transform &transform, Mesh *&mesh) {
-    if (mesh->material.dissolve > 0.99F && !mesh->material.alpha_texture.has_value()) {
-      render_info.dist = std::numeric_limits<float>::max();
-      return;
-    }
+  frame_stats_ = {};
+  ReadFragmentQueries();
+  frame_buffer_->BeginFrame();
+  UploadDirtyMaterials();
+  BuildDrawList();
 
-    render_info.dist = glm::distance2(scene_->camera().position(), transform.location + mesh->bounding_box.center());
-  });
-  scene_->registry().sort<RenderObject>([](const RenderObject &lhs, const RenderObject &rhs) {
-    return lhs.dist < rhs.dist;
-  });
+  // Textures are stamped as they are bound, and evicted once the frame is drawn if they were not.
+  frame_index_++;
+  StreamTextures();
 
   // Start depth map render pass
 
   glViewport(0, 0, kShadowMapSize, kShadowMapSize);
 
-  depth_map_shader_->Use();
-  glActiveTexture(GL_TEXTURE0);
-  glUniform1i(glGetUniformLocation(depth_map_shader_->program(), "alphaTexture"), 0);
+  // Texture names may have been reused since last frame, and scene setup binds programs and vertex arrays itself.
+  bound_textures_ = {};
+  bound_vertex_array_ = 0;
+  bound_program_ = 0;
+  glBindVertexArray(0);
+
+  ScheduleShadowUpdates();
+
+  UseProgram(cube_depth_map_shader_->program());
   for (auto &&[object, point_light, depth_map, framebuffer] : GetPointLightsInfo(scene_).each()) {
+    if (!shadow_scheduler_.ShouldUpdate(object)) {
+      continue;
+    }
+    auto &static_shadow_cache = scene_->registry().get<StaticShadowCache>(object);
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
     const glm::mat4 light_projection =
         glm::perspective(glm::radians(90.0F), 1.0F, point_light.near_plane, point_light.far_plane);
-    for (int j = 0; j < 6; j++) {
-      glFramebufferTexture2D(
-          GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + j, depth_map.texture(), 0
+    const glm::mat4 culling_projection =
+        glm::perspective(glm::radians(90.0F), 1.0F, point_light.near_plane, ShadowRange(point_light));
+    // The whole cube is attached as a layered target.
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_map.texture(), 0);
+
+    std::array<glm::mat4, 6> face_matrices{};
+    std::array<glm::mat4, 6> culling_matrices{};
+    for (int face = 0; face < 6; ++face) {
+      const glm::mat4 light_view = glm::lookAt(
+          point_light.position, point_light.position + kCubeMapDirections.at(face), kCubeMapUpVectors.at(face)
       );
-      glClear(GL_DEPTH_BUFFER_BIT);
-
-      const glm::mat4 light_view =
-          glm::lookAt(point_light.position, point_light.position + kCubeMapDirections.at(j), kCubeMapUpVectors.at(j));
-      const glm::mat4 light_space_matrix = light_projection * light_view;
-      Uniform<glm::mat4> light_space_matrix_uniform(
-          depth_map_shader_->program(), "lightSpaceMatrix", light_space_matrix
-      );
-      light_space_matrix_uniform.UpdateValue(light_space_matrix);
-
-      RenderDepthMap();
+      face_matrices.at(face) = light_projection * light_view;
+      culling_matrices.at(face) = culling_projection * light_view;
     }
+    UpdateShadowMap(
+        static_shadow_cache,
+        depth_map,
+        GL_TEXTURE_CUBE_MAP,
+        {0, 0, kShadowMapSize},
+        face_matrices,
+        [&](const bool dynamic_casters) { RenderCubeDepthMap(face_matrices, culling_matrices, dynamic_casters); }
+    );
   }
 
-  depth_map_shader_->Use();
-  {
-    auto [directional_light, depth_map, framebuffer] = GetDirectionalLightInfo(scene_);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    const glm::mat4 light_projection = glm::ortho(-20.0F, 20.0F, -20.0F, 20.0F, 0.1F, 100.0F);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_map.texture(), 0);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    const glm::mat4 light_view =
-        glm::lookAt(10.0F * glm::normalize(directional_light.direction), glm::vec3(0.0F), glm::vec3(0.0F, 1.0F, 0.0F));
-    glm::mat4 light_space_matrix = light_projection * light_view;
-    Uniform<glm::mat4> light_space_matrix_uniform(depth_map_shader_->program(), "lightSpaceMatrix", light_space_matrix);
-    light_space_matrix_uniform.UpdateValue(light_space_matrix);
-
-    light_space_matrices_.UpdateSubData(&light_space_matrix, 0, sizeof(glm::mat4));
+  // Directional and spot lights all render into tiles of the shadow atlas.
+  UseProgram(depth_map_shader_->program());
+  glBindFramebuffer(GL_FRAMEBUFFER, shadow_atlas_framebuffer_);
+  glEnable(GL_SCISSOR_TEST);
+  if (auto view = scene_->GetAllObjectsWith<DirectionalLight, StaticShadowCache>();
+      shadow_scheduler_.ShouldUpdate(view.front())) {
+    auto [directional_light, tile] = GetDirectionalLightInfo(scene_);
+    auto &static_shadow_cache = view.get<StaticShadowCache>(view.front());
+    SetShadowTile(tile);
+
+    const std::array<float, kDirectionalCascadeCount> splits = CascadeSplits(scene_->camera());
+    const std::array<glm::mat4, kDirectionalCascadeCount> cascade_matrices =
+        FitDirectionalCascades(directional_light, scene_->camera(), splits, tile.size / 2, scene_bounds_);
+
+    for (int cascade = 0; cascade < kDirectionalCascadeCount; ++cascade) {
+      cascade_splits_[cascade] = splits.at(cascade);
+      light_spaces_[cascade] = {cascade_matrices.at(cascade), shadow_atlas_.UvRect(CascadeTile(tile, cascade))};
+    }
 
-    RenderDepthMap();
+    UpdateShadowMap(
+        static_shadow_cache,
+        *shadow_atlas_texture_,
+        GL_TEXTURE_2D,
+        tile,
+        cascade_matrices,
+        [&](const bool dynamic_casters) {
+          // Each cascade only draws the casters inside its own projection.
+          for (int cascade = 0; cascade < kDirectionalCascadeCount; ++cascade) {
+            const ShadowAtlas::Tile cascade_tile = CascadeTile(tile, cascade);
+            glViewport(cascade_tile.x, cascade_tile.y, cascade_tile.size, cascade_tile.size);
+            RenderDepthMap(cascade_matrices.at(cascade), cascade_matrices.at(cascade), dynamic_casters);
+          }
+        }
+    );
   }
 
-  depth_map_shader_->Use();
-  size_t light_space_matrix_offset = sizeof(glm::mat4);
-  for (auto &&[object, spot_light, depth_map, framebuffer] : GetSpotLightsInfo(scene_).each()) {
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  // Light spaces follow the order of the spot light storage block, including the lights the atlas had no tile for.
+  size_t light_space_index = kDirectionalCascadeCount;
+  for (auto &&[object, spot_light] : scene_->GetAllObjectsWith<SpotLight>().each()) {
+    // Skipped lights keep both their shadow map and the matrix it was rendered with.
+    LightSpaceData &light_space = light_spaces_[light_space_index++];
+    const auto *tile = scene_->registry().try_get<ShadowAtlas::Tile>(object);
+    if (tile == nullptr || !shadow_scheduler_.ShouldUpdate(object)) {
+      continue;
+    }
+    auto &static_shadow_cache = scene_->registry().get<StaticShadowCache>(object);
+    SetShadowTile(*tile);
     const glm::mat4 light_projection =
         glm::perspective(glm::radians(spot_light.outer_cutoff * 2.0F), 1.0F, 0.1F, 10.0F);
+    const glm::mat4 culling_projection =
+        glm::perspective(glm::radians(spot_light.outer_cutoff * 2.0F), 1.0F, 0.1F, ShadowRange(spot_light));
 
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_map.texture(), 0);
-    glClear(GL_DEPTH_BUFFER_BIT);
     const glm::mat4 light_view =
         glm::lookAt(spot_light.position, spot_light.position + spot_light.direction, glm::vec3(0.0F, 1.0F, 0.0F));
     glm::mat4 light_space_matrix = light_projection * light_view;
-    Uniform<glm::mat4> light_space_matrix_uniform(depth_map_shader_->program(), "lightSpaceMatrix", light_space_matrix);
-    light_space_matrix_uniform.UpdateValue(light_space_matrix);
-
-    light_space_matrices_.UpdateSubData(&light_space_matrix, light_space_matrix_offset, sizeof(glm::mat4));
-    light_space_matrix_offset += sizeof(glm::mat4);
 
-    RenderDepthMap();
+    light_space = {light_space_matrix, shadow_atlas_.UvRect(*tile)};
+
+    UpdateShadowMap(
+        static_shadow_cache,
+        *shadow_atlas_texture_,
+        GL_TEXTURE_2D,
+        *tile,
+        {&light_space_matrix, 1},
+        [&](const bool dynamic_casters) {
+          RenderDepthMap(light_space_matrix, culling_projection * light_view, dynamic_casters);
+        }
+    );
   }
+  glDisable(GL_SCISSOR_TEST);
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -368,133 +1039,412 @@ void Renderer::Render() {
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  MatricesUBOData matrices_ubo_data = {scene_->camera().GetViewMatrix(), scene_->camera().GetProjectionMatrix()};
-  matrices_ubo_.UpdateData(&matrices_ubo_data, sizeof(MatricesUBOData));
-  matrices_ubo_.Rebind();
+  MatricesUBOData matrices_ubo_data = {
+      scene_->camera().GetViewMatrix(),
+      scene_->camera().GetProjectionMatrix(),
+      scene_->camera().GetProjectionMatrix() * scene_->camera().GetViewMatrix()
+  };
+  frame_buffer_->BindRange(
+      GL_UNIFORM_BUFFER,
+      kMatricesUBOBindingPoint,
+      frame_buffer_->Write(std::span<const MatricesUBOData>(&matrices_ubo_data, 1))
+  );
 
-  // Send light data
-  size_t lights_uniform_offset = 0;
+  // Send light data in eye space. The directional light goes into the lights block, point and spot lights into storage
+  // blocks that the light grid's clusters index.
   {
     auto view = scene_->GetAllObjectsWith<DirectionalLight>();
     DirectionalLight light = view.get<DirectionalLight>(view.front());
     light.direction = glm::vec3(scene_->camera().GetViewMatrix() * glm::vec4(light.direction, 0.0F));
-    lights_.UpdateSubData(&light, 0, sizeof(DirectionalLight));
-    lights_uniform_offset += sizeof(DirectionalLight);
+    frame_buffer_->BindRange(
+        GL_UNIFORM_BUFFER, kLightsUBOBindingPoint, frame_buffer_->Write(std::span<const DirectionalLight>(&light, 1))
+    );
   }
 
+  light_grid_.SetView(
+      scene_->camera().GetProjectionMatrix(),
+      scene_->camera().near_plane(),
+      scene_->camera().far_plane(),
+      static_cast<int>(window_->extent().width),
+      static_cast<int>(window_->extent().height)
+  );
   {
-    for (auto &&[_, point_light] : scene_->GetAllObjectsWith<PointLight>().each()) {
+    auto view = scene_->GetAllObjectsWith<PointLight>();
+    const FrameRingBuffer::Allocation point_lights = frame_buffer_->Allocate(view.size() * sizeof(PointLight));
+    std::byte *light_data = point_lights.data;
+    for (auto &&[_, point_light] : view.each()) {
       PointLight light = point_light;
       light.positionEyeSpace = glm::vec3(scene_->camera().GetViewMatrix() * glm::vec4(light.position, 1.0F));
-      lights_.UpdateSubData(&light, lights_uniform_offset, sizeof(PointLight));
-      lights_uniform_offset += sizeof(PointLight);
+      light_grid_.AddPointLight(
+          light.positionEyeSpace, AttenuationRange(light.constant, light.linear, light.quadratic)
+      );
+      std::memcpy(light_data, &light, sizeof(PointLight));
+      light_data += sizeof(PointLight);
     }
+    frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kPointLightsSSBOBindingPoint, point_lights);
   }
 
   {
-    for (auto &&[_, spot_light] : scene_->GetAllObjectsWith<SpotLight>().each()) {
+    auto view = scene_->GetAllObjectsWith<SpotLight>();
+    const FrameRingBuffer::Allocation spot_lights = frame_buffer_->Allocate(view.size() * sizeof(SpotLight));
+    std::byte *light_data = spot_lights.data;
+    for (auto &&[_, spot_light] : view.each()) {
       SpotLight light = spot_light;
       light.position = glm::vec3(scene_->camera().GetViewMatrix() * glm::vec4(light.position, 1.0F));
       light.direction = glm::vec3(scene_->camera().GetViewMatrix() * glm::vec4(light.direction, 0.0F));
-      lights_.UpdateSubData(&light, lights_uniform_offset, sizeof(SpotLight));
-      lights_uniform_offset += sizeof(SpotLight);
+      light_grid_.AddSpotLight(
+          light.position,
+          light.direction,
+          glm::radians(light.outer_cutoff),
+          AttenuationRange(light.constant, light.linear, light.quadratic)
+      );
+      // The shaders compare the cutoffs with the cosine of the angle to the light's direction.
+      light.inner_cutoff = std::cos(glm::radians(light.inner_cutoff));
+      light.outer_cutoff = std::cos(glm::radians(light.outer_cutoff));
+      std::memcpy(light_data, &light, sizeof(SpotLight));
+      light_data += sizeof(SpotLight);
     }
+    frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kSpotLightsSSBOBindingPoint, spot_lights);
   }
-  lights_.Rebind();
-
-  // Send object data
-
-  MaterialUBOData material_ubo_data{};
-
-  for (auto &&[_, render_info, transform, mesh] : GetRenderInfo(scene_).each()) {
-    shaders_[render_info.shader_index].Use();
-
-    light_space_matrices_.Rebind();
 
-    glm::mat4 model_matrix = transform.GetMatrix();
-    render_info.model.UpdateValue(model_matrix);
-    render_info.normal_matrix.UpdateValue(glm::mat3(glm::inverseTranspose(matrices_ubo_data.view * model_matrix)));
-
-    const Material &material = mesh->material;
-
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "UnusedValue"
-    material_ubo_data.shininess = material.shininess;
-    material_ubo_data.opticalDensity = material.optical_density;
-    material_ubo_data.dissolve = material.dissolve;
-    material_ubo_data.diffuseColor = material.diffuse_color;
-    material_ubo_data.ambientColor = material.ambient_color;
-    material_ubo_data.specularColor = material.specular_color;
-    material_ubo_data.transmissionFilterColor = material.transmission_filter_color;
-#pragma clang diagnostic pop
+  light_grid_.Assign();
+  {
+    const std::span<const LightGrid::Range> ranges = light_grid_.ranges();
+    const FrameRingBuffer::Allocation clusters =
+        frame_buffer_->Allocate(sizeof(LightClustersHeader) + ranges.size_bytes());
+    const LightClustersHeader header = {
+        glm::uvec4(LightGrid::kClustersX, LightGrid::kClustersY, LightGrid::kClustersZ, 0), light_grid_.params()
+    };
+    std::memcpy(clusters.data, &header, sizeof(LightClustersHeader));
+    std::memcpy(clusters.data + sizeof(LightClustersHeader), ranges.data(), ranges.size_bytes());
+    frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kLightClustersSSBOBindingPoint, clusters);
+
+    // Never empty, so that the block stays bound even when no light reaches the view.
+    const std::span<const uint32_t> light_indices = light_grid_.light_indices();
+    const FrameRingBuffer::Allocation indices =
+        frame_buffer_->Allocate(std::max<size_t>(light_indices.size(), 1) * sizeof(uint32_t));
+    std::memcpy(indices.data, light_indices.data(), light_indices.size_bytes());
+    frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kLightIndicesSSBOBindingPoint, indices);
+    frame_stats_.clustered_lights = static_cast<int>(light_indices.size());
+  }
 
-    render_info.material_data.UpdateData(&material_ubo_data, sizeof(MaterialUBOData));
-    render_info.material_data.Rebind();
+  // Send object data
 
-    // Send shadow map data
+  // Shadow maps in the order of the units stored in ShaderVariant::shadow_map_units.
+  std::vector<std::pair<GLenum, GLuint>> shadow_maps;
+  shadow_maps.emplace_back(
+      GL_TEXTURE_CUBE_MAP_ARRAY, point_shadow_maps_ != nullptr ? point_shadow_maps_->texture() : 0
+  );
+  shadow_maps.emplace_back(GL_TEXTURE_2D, shadow_atlas_texture_->texture());
 
-    int texture_index = 0;
-    int array_index = 0;
-    for (auto &&[_, point_light, depth_map, framebuffer] : GetPointLightsInfo(scene_).each()) {
-      glActiveTexture(GL_TEXTURE0 + texture_index);
-      glUniform1i(
-          glGetUniformLocation(
-              shaders_[render_info.shader_index].program(), std::format("{}[{}]", depth_map.name(), array_index).c_str()
-          ),
-          texture_index
+  const FrameRingBuffer::Allocation light_spaces =
+      frame_buffer_->Allocate(kLightSpacesOffset + light_spaces_.size() * sizeof(LightSpaceData));
+  std::memcpy(light_spaces.data, &cascade_splits_, sizeof(cascade_splits_));
+  std::memcpy(
+      light_spaces.data + kLightSpacesOffset, light_spaces_.data(), light_spaces_.size() * sizeof(LightSpaceData)
+  );
+  frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kLightSpacesSSBOBindingPoint, light_spaces);
+
+  auto view = GetRenderInfo(scene_);
+  const std::span<const DrawList::Command> main_pass = draw_list_.Pass(DrawPass::kMain);
+  // Opaque draws come first in the main pass, transparent ones after them.
+  const auto is_opaque = [&](const DrawList::Command &command) {
+    return !view.get<RenderObject>(command.entity).transparent;
+  };
+  const auto opaque_count =
+      static_cast<size_t>(std::ranges::partition_point(main_pass, is_opaque) - main_pass.begin());
+  FragmentQueries &fragment_queries = fragment_queries_[fragment_query_index_];
+  fragment_queries.issued = true;
+
+  // The depth pre-pass lays down the depth of the opaque draws with the depth map program, fetching positions only.
+  // The opaque draws of the main pass then test for equal depth, so each pixel is shaded at most once.
+  glBeginQuery(GL_SAMPLES_PASSED, fragment_queries.prepass);
+  if (settings_.depth_prepass && opaque_count > 0) {
+    const FrameRingBuffer::Allocation instances = frame_buffer_->Allocate(opaque_count * sizeof(ShadowInstance));
+    const FrameRingBuffer::Allocation prepass_commands =
+        frame_buffer_->Allocate(opaque_count * sizeof(DrawElementsIndirectCommand));
+    size_t prepass_command_count = 0;
+    for (size_t run = 0; run < opaque_count;) {
+      const GeometryBuffer::Range &geometry = view.get<RenderObject>(main_pass[run].entity).geometry;
+      size_t run_end = run;
+      for (; run_end < opaque_count && view.get<RenderObject>(main_pass[run_end].entity).geometry.mesh == geometry.mesh;
+           ++run_end) {
+        const ShadowInstance instance{view.get<Transform>(main_pass[run_end].entity).GetMatrix(), 0};
+        std::memcpy(instances.data + run_end * sizeof(ShadowInstance), &instance, sizeof(ShadowInstance));
+      }
+      const DrawElementsIndirectCommand indirect_command{
+          static_cast<GLuint>(geometry.index_count),
+          static_cast<GLuint>(run_end - run),
+          geometry.first_index,
+          geometry.base_vertex,
+          static_cast<GLuint>(run)
+      };
+      std::memcpy(
+          prepass_commands.data + prepass_command_count * sizeof(DrawElementsIndirectCommand),
+          &indirect_command,
+          sizeof(indirect_command)
       );
-      glBindTexture(GL_TEXTURE_CUBE_MAP, depth_map.texture());
-      texture_index++;
-      array_index++;
+      prepass_command_count++;
+      run = run_end;
     }
+    frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kDrawDataSSBOBindingPoint, instances);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frame_buffer_->buffer());
 
-    {
-      auto [directional_light, depth_map, framebuffer] = GetDirectionalLightInfo(scene_);
-      glActiveTexture(GL_TEXTURE0 + texture_index);
-      glUniform1i(
-          glGetUniformLocation(
-              shaders_[render_info.shader_index].program(), std::format("{}[{}]", depth_map.name(), 0).c_str()
+    // Opaque draws have no alpha to test.
+    UseProgram(depth_map_shader_->program());
+    glUniformMatrix4fv(
+        depth_map_light_space_matrix_location_, 1, GL_FALSE, glm::value_ptr(matrices_ubo_data.view_projection)
+    );
+    glUniform1f(depth_map_dissolve_location_, 1.0F);
+    BindTexture(depth_map_alpha_unit_, GL_TEXTURE_2D, white_pixel_->texture());
+    BindVertexArray(geometry_buffer_->position_vertex_array());
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES,
+        GL_UNSIGNED_INT,
+        reinterpret_cast<const void *>(prepass_commands.offset),
+        static_cast<GLsizei>(prepass_command_count),
+        0
+    );
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    frame_stats_.draws++;
+    frame_stats_.indirect_draws += static_cast<int>(prepass_command_count);
+    frame_stats_.instances += static_cast<int>(opaque_count);
+  }
+  glEndQuery(GL_SAMPLES_PASSED);
+
+  // Per-draw data of every draw of the main pass in draw list order, and room for at most one indirect command per
+  // draw. Both are written straight into the frame's region of the ring buffer.
+  const FrameRingBuffer::Allocation draw_data = frame_buffer_->Allocate(main_pass.size() * sizeof(DrawData));
+  const FrameRingBuffer::Allocation indirect_commands =
+      frame_buffer_->Allocate(main_pass.size() * sizeof(DrawElementsIndirectCommand));
+  for (size_t i = 0; i < main_pass.size(); ++i) {
+    auto [render_info, transform] = view.get<RenderObject, Transform>(main_pass[i].entity);
+    const glm::mat4 model_matrix = transform.GetMatrix();
+    const DrawData data{
+        model_matrix, glm::inverseTranspose(matrices_ubo_data.view * model_matrix), render_info.material_data_index
+    };
+    std::memcpy(draw_data.data + i * sizeof(DrawData), &data, sizeof(DrawData));
+  }
+  frame_buffer_->BindRange(GL_SHADER_STORAGE_BUFFER, kDrawDataSSBOBindingPoint, draw_data);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kMaterialsSSBOBindingPoint, material_buffer_);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frame_buffer_->buffer());
+
+  // Consecutive draws with the same program and textures go out as one multi-draw. The draw list is sorted by both, so
+  // opaque draws form one batch per material, transparent draws only merge when neighbours in depth share state.
+  size_t command_count = 0;
+  const auto draw_batches = [&](const size_t begin, const size_t end) {
+    for (size_t first = begin; first < end;) {
+      auto [render_info, transform, mesh] = view.get<RenderObject, Transform, Mesh *>(main_pass[first].entity);
+      if (!render_info.shader_ready) {
+        if (!shader_allocator_->IsReady(shader_variants_[render_info.shader_index].shader.program())) {
+          DrawWithFallbackShader(render_info, transform, *mesh);
+          first++;
+          continue;
+        }
+        FinishShaderSetup(render_info);
+      }
+
+      size_t last = first + 1;
+      for (; last < end; ++last) {
+        auto &next = view.get<RenderObject>(main_pass[last].entity);
+        if (next.shader_index != render_info.shader_index || next.material_index != render_info.material_index) {
+          break;
+        }
+        // The program is ready, since it is the one of the first draw.
+        if (!next.shader_ready) {
+          FinishShaderSetup(next);
+        }
+      }
+
+      UseProgram(shader_variants_[render_info.shader_index].shader.program());
+
+      // Send shadow map data
+
+      const std::vector<int> &shadow_map_units = shader_variants_[render_info.shader_index].shadow_map_units;
+      for (size_t i = 0; i < shadow_maps.size(); ++i) {
+        if (shadow_map_units[i] >= 0) {
+          BindTexture(shadow_map_units[i], shadow_maps[i].first, shadow_maps[i].second);
+        }
+      }
+
+      for (size_t i = 0; i < render_info.textures.size(); ++i) {
+        if (render_info.texture_units[i] >= 0) {
+          BindTexture(render_info.texture_units[i], GL_TEXTURE_2D, render_info.textures[i].texture());
+        }
+      }
+
+      for (size_t i = 0; i < render_info.texture_layers.size(); ++i) {
+        if (render_info.texture_layer_units[i] >= 0) {
+          BindTexture(
+              render_info.texture_layer_units[i], GL_TEXTURE_2D_ARRAY, render_info.texture_layers[i].texture_array
+          );
+        }
+      }
+
+      // Neighbouring draws of one mesh become the instances of one command, the base instance pointing at the draw data
+      // of the first of them.
+      const size_t first_command = command_count;
+      for (size_t run = first; run < last;) {
+        const GeometryBuffer::Range &geometry = view.get<RenderObject>(main_pass[run].entity).geometry;
+        size_t run_end = run + 1;
+        while (run_end < last && view.get<RenderObject>(main_pass[run_end].entity).geometry.mesh == geometry.mesh) {
+          run_end++;
+        }
+        const DrawElementsIndirectCommand indirect_command{
+            static_cast<GLuint>(geometry.index_count),
+            static_cast<GLuint>(run_end - run),
+            geometry.first_index,
+            geometry.base_vertex,
+            static_cast<GLuint>(run)
+        };
+        std::memcpy(
+            indirect_commands.data + command_count * sizeof(DrawElementsIndirectCommand),
+            &indirect_command,
+            sizeof(indirect_command)
+        );
+        command_count++;
+        run = run_end;
+      }
+
+      BindVertexArray(geometry_buffer_->vertex_array());
+      glMultiDrawElementsIndirect(
+          GL_TRIANGLES,
+          GL_UNSIGNED_INT,
+          reinterpret_cast<const void *>(
+              indirect_commands.offset + first_command * sizeof(DrawElementsIndirectCommand)
           ),
-          texture_index
+          static_cast<GLsizei>(command_count - first_command),
+          0
       );
-      glBindTexture(GL_TEXTURE_2D, depth_map.texture());
-      texture_index++;
+      frame_stats_.draws++;
+      frame_stats_.indirect_draws += static_cast<int>(command_count - first_command);
+      frame_stats_.instances += static_cast<int>(last - first);
+      first = last;
     }
+  };
 
-    array_index = 0;
-    for (auto &&[_, spot_light, depth_map, framebuffer] : GetSpotLightsInfo(scene_).each()) {
-      glActiveTexture(GL_TEXTURE0 + texture_index);
-      glUniform1i(
-          glGetUniformLocation(
-              shaders_[render_info.shader_index].program(), std::format("{}[{}]", depth_map.name(), array_index).c_str()
-          ),
-          texture_index
-      );
-      glBindTexture(GL_TEXTURE_2D, depth_map.texture());
-      texture_index++;
-      array_index++;
-    }
+  if (settings_.depth_prepass) {
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+  }
+  glBeginQuery(GL_SAMPLES_PASSED, fragment_queries.shaded);
+  draw_batches(0, opaque_count);
+  glEndQuery(GL_SAMPLES_PASSED);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  draw_batches(opaque_count, main_pass.size());
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  LOG_EVERY_N_SEC(INFO, 10) << "Frame state changes: " << frame_stats_.program_binds << " programs, "
+                            << frame_stats_.texture_binds << " textures, " << frame_stats_.vertex_array_binds
+                            << " vertex arrays for " << frame_stats_.draws << " draw calls covering "
+                            << frame_stats_.indirect_draws << " indirect draws of " << frame_stats_.instances
+                            << " instances, "
+                            << frame_stats_.shaded_fragments << " opaque fragments shaded, "
+                            << frame_stats_.prepass_saved_fragments << " saved by the depth pre-pass, "
+                            << frame_stats_.occlusion_culled << " objects occluded by "
+                            << frame_stats_.occluder_triangles << " occluder triangles, "
+                            << frame_stats_.clustered_lights << " cluster light entries, "
+                            << frame_stats_.shadow_map_updates << " shadow maps updated, at most "
+                            << frame_stats_.max_shadow_staleness << " frames stale";
+
+  texture_allocator_->EnforceMemoryBudget(frame_index_);
+  frame_buffer_->EndFrame();
+  window_->SwapBuffers();
+}
 
-    for (int i = 0; i < render_info.textures.size(); ++i) {
-      glActiveTexture(GL_TEXTURE0 + texture_index);
-      const int location =
-          glGetUniformLocation(shaders_[render_info.shader_index].program(), render_info.textures[i].name().c_str());
-      glUniform1i(location, texture_index);
-      glBindTexture(GL_TEXTURE_2D, render_info.textures[i].texture());
-      texture_index++;
-    }
+void Renderer::ReadFragmentQueries() {
+  fragment_query_index_ = (fragment_query_index_ + 1) % kFragmentQueryFrames;
+  const FragmentQueries &queries = fragment_queries_[fragment_query_index_];
+  if (!queries.issued) {
+    return;
+  }
+  // Results of earlier queries of the same target are available once the last one's is.
+  GLuint available = GL_FALSE;
+  glGetQueryObjectuiv(queries.shaded, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available == GL_FALSE) {
+    return;
+  }
+  GLuint64 prepass = 0;
+  GLuint64 shaded = 0;
+  glGetQueryObjectui64v(queries.prepass, GL_QUERY_RESULT, &prepass);
+  glGetQueryObjectui64v(queries.shaded, GL_QUERY_RESULT, &shaded);
+  // The pre-pass draws the opaque draws in the same order as the main pass with a less depth test, so its samples are
+  // the fragments the main pass would have shaded without it.
+  frame_stats_.shaded_fragments = static_cast<int64_t>(shaded);
+  frame_stats_.prepass_saved_fragments = prepass > shaded ? static_cast<int64_t>(prepass - shaded) : 0;
+}
+
+void Renderer::AddShadowAtlasTile(entt::entity light, int preferred_size) {
+  std::optional<ShadowAtlas::Tile> tile;
+  for (int size = preferred_size; !tile.has_value() && size >= kMinShadowTileSize; size /= 2) {
+    tile = shadow_atlas_.Allocate(size);
+  }
+  if (!tile.has_value()) {
+    // The light keeps a zero atlas rect in its light space, which the shaders read as unshadowed.
+    LOG(WARNING) << "Shadow atlas has no room left for light " << static_cast<uint32_t>(light)
+                 << ", it is drawn without shadows";
+    return;
+  }
+  scene_->AddComponent(light, *tile);
+  scene_->AddComponent(
+      light, StaticShadowCache{Texture(tile->size, tile->size, "staticDepthMap", *texture_allocator_), {}, false, false}
+  );
+}
 
-    glBindVertexArray(render_info.vao);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh->indices.size()), GL_UNSIGNED_INT, nullptr);
-    glBindVertexArray(0);
+void Renderer::FinishShaderSetup(RenderObject &render_info) {
+  ShaderVariant &variant = shader_variants_[render_info.shader_index];
+  const GLuint program = variant.shader.program();
+  // Sampler units are program state, so they are set up once per variant. Blocks are bound in the shaders.
+  if (!variant.set_up) {
+    variant.reflection = ProgramReflection(program);
+    // Every sampler gets a unit of its own, which adds up with unpacked material textures.
+    GLint max_texture_units = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_texture_units);
+    CHECK_LE(variant.reflection.sampler_unit_count(), std::min<int>(max_texture_units, kMaxBoundTextureUnits))
+        << "Shader variant " << variant.key.bits() << " samples more textures than the renderer can bind, the driver "
+        << "allows " << max_texture_units << " fragment texture units and the renderer tracks "
+        << kMaxBoundTextureUnits;
+    variant.shadow_map_units.clear();
+    variant.shadow_map_units.push_back(variant.reflection.SamplerUnit("pointShadowMaps"));
+    variant.shadow_map_units.push_back(variant.reflection.SamplerUnit("shadowAtlas"));
+    variant.set_up = true;
+  }
 
-    for (int i = 0; i < texture_index; ++i) {
-      glActiveTexture(GL_TEXTURE0 + i);
-      glBindTexture(GL_TEXTURE_2D, 0);
-    }
+  render_info.texture_units.clear();
+  for (const Texture &texture : render_info.textures) {
+    render_info.texture_units.push_back(variant.reflection.SamplerUnit(texture.name()));
+  }
+  render_info.texture_layer_units.clear();
+  for (const TextureLayer &texture_layer : render_info.texture_layers) {
+    render_info.texture_layer_units.push_back(variant.reflection.SamplerUnit(texture_layer.name));
   }
 
-  window_->SwapBuffers();
+  render_info.shader_ready = true;
+}
+
+void Renderer::DrawGeometry(const GeometryBuffer::Range &geometry, GLuint base_instance, GLsizei instance_count) {
+  BindVertexArray(geometry_buffer_->vertex_array());
+  glDrawElementsInstancedBaseVertexBaseInstance(
+      GL_TRIANGLES,
+      geometry.index_count,
+      GL_UNSIGNED_INT,
+      geometry.index_offset(),
+      instance_count,
+      geometry.base_vertex,
+      base_instance
+  );
+  frame_stats_.draws++;
+  frame_stats_.instances += instance_count;
+}
+
+void Renderer::DrawWithFallbackShader(const RenderObject &render_info, const Transform &transform, const Mesh &mesh) {
+  UseProgram(fallback_shader_->program());
+  glUniformMatrix4fv(fallback_model_location_, 1, GL_FALSE, glm::value_ptr(transform.GetMatrix()));
+  glUniform3fv(fallback_color_location_, 1, glm::value_ptr(mesh.material.diffuse_color));
+
+  DrawGeometry(render_info.geometry, 0, 1);
 }
 
 void Renderer::SetupScene(Scene &scene) {
@@ -503,182 +1453,235 @@ void Renderer::SetupScene(Scene &scene) {
   scene_->ClearDirtyBit();
 
   scene_->RemoveComponentFromAll<RenderObject>();
-  shaders_.clear();
+  texture_array_packer_->Clear();
+  shader_variants_.clear();
+  shader_variant_indices_.clear();
   // Delete depth maps from lights
   scene_->RemoveComponentFromAll<Texture>();
+  scene_->RemoveComponentFromAll<StaticShadowCache>();
+  scene_->RemoveComponentFromAll<ShadowAtlas::Tile>();
+  shadow_atlas_.Clear();
+  shadow_scheduler_.Clear();
 
   // Delete framebuffers from lights
   scene_->GetAllObjectsWith<GLuint>().each([](GLuint &framebuffer) { glDeleteBuffers(1, &framebuffer); });
   scene_->RemoveComponentFromAll<GLuint>();
 
-  shaders_.reserve(scene_->GetAllObjectsWith<Mesh *>().size());
-
-  matrices_ubo_ = UniformBuffer(2 * sizeof(glm::mat4));
-  size_t point_light_count = scene_->GetAllObjectsWith<PointLight>().size();
-  size_t spot_light_count = scene_->GetAllObjectsWith<SpotLight>().size();
+  cascade_splits_ = {};
+  light_spaces_.assign(kDirectionalCascadeCount + scene_->GetAllObjectsWith<SpotLight>().size(), {});
 
-  light_space_matrices_ = UniformBuffer((1 + spot_light_count) * sizeof(glm::mat4));
-  lights_ = UniformBuffer(
-      sizeof(DirectionalLight) + point_light_count * sizeof(PointLight) + spot_light_count * sizeof(SpotLight)
-  );
-
-  for (auto &&[entity, _] : scene_->GetAllObjectsWith<PointLight>().each()) {
+  // The first point lights get a cube of the shadow map array, rendered through a cube map view of it.
+  const size_t point_light_count = scene_->GetAllObjectsWith<PointLight>().size();
+  const int shadowed_point_lights = static_cast<int>(std::min<size_t>(point_light_count, kMaxShadowedPointLights));
+  point_shadow_maps_.reset();
+  if (shadowed_point_lights > 0) {
+    point_shadow_maps_ = std::make_unique<Texture>(
+        Texture::CubeDepthMapArray(kShadowMapSize, shadowed_point_lights, "pointShadowMaps", *texture_allocator_)
+    );
+  }
+  if (point_light_count > static_cast<size_t>(shadowed_point_lights)) {
+    LOG(WARNING) << "Only " << kMaxShadowedPointLights << " of " << point_light_count
+                 << " point lights cast shadows, the others are drawn without";
+  }
+  int shadow_layer = 0;
+  for (auto &&[entity, point_light] : scene_->GetAllObjectsWith<PointLight>().each()) {
+    if (shadow_layer == shadowed_point_lights) {
+      point_light.shadow_layer = -1;
+      continue;
+    }
+    point_light.shadow_layer = shadow_layer;
     GLuint framebuffer = 0;
     glGenFramebuffers(1, &framebuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    Texture depth_map(kShadowMapSize, "pointDepthMaps", *texture_allocator_);
+    Texture depth_map =
+        Texture::CubeDepthMapView(*point_shadow_maps_, shadow_layer++, "pointShadowMap", *texture_allocator_);
     scene_->AddComponent(entity, framebuffer);
     scene_->AddComponent(entity, std::move(depth_map));
+    scene_->AddComponent(
+        entity, StaticShadowCache{Texture(kShadowMapSize, "staticPointDepthMap", *texture_allocator_), {}, false, false}
+    );
   }
 
   {
     auto view = scene_->GetAllObjectsWith<DirectionalLight>();
-    auto entity = view.front();
-    GLuint framebuffer = 0;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    Texture depth_map(kShadowMapSize, kShadowMapSize, "directionalDepthMaps", *texture_allocator_);
-    scene_->AddComponent(entity, framebuffer);
-    scene_->AddComponent(entity, std::move(depth_map));
+    AddShadowAtlasTile(view.front(), kShadowMapSize);
   }
-
   for (auto &&[entity, _] : scene_->GetAllObjectsWith<SpotLight>().each()) {
-    GLuint framebuffer = 0;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    Texture depth_map(kShadowMapSize, kShadowMapSize, "spotDepthMaps", *texture_allocator_);
-    scene_->AddComponent(entity, framebuffer);
-    scene_->AddComponent(entity, std::move(depth_map));
+    AddShadowAtlasTile(entity, kShadowMapSize / 2);
   }
 
+  geometry_buffer_->Clear();
   int index = 0;
   for (auto &&[entity, transform, mesh] : scene_->GetAllObjectsWith<Transform, Mesh *>().each()) {
     LOG(INFO) << "Setting up object " << index;
     RenderObject render_info;
 
     AttachMaterial(render_info, mesh->material);
-    matrices_ubo_.Bind(shaders_[index].program(), "Matrices", kMatricesUBOBindingPoint);
-    lights_.Bind(shaders_[index].program(), "Lights", kLightsUBOBindingPoint);
-    light_space_matrices_.Bind(shaders_[index].program(), "LightSpaceMatrices", kLightSpaceMatricesUBOBindingPoint);
 
-    if (mesh->material.dissolve > 0.99F && !mesh->material.alpha_texture.has_value()) {
-      render_info.dist = std::numeric_limits<float>::max();
-    }
-    else {
-      render_info.dist = glm::distance2(scene_->camera().position(), transform.location);
-    }
+    render_info.transparent = mesh->material.dissolve <= 0.99F || mesh->material.alpha_texture.has_value();
+    render_info.static_model = transform.GetMatrix();
 
     render_info.object_index = index;
-    render_info.shader_index = index;
-    render_info.model = Uniform<glm::mat4>(shaders_[index].program(), "model", transform.GetMatrix());
-    render_info.shadow_model = Uniform<glm::mat4>(depth_map_shader_->program(), "model", transform.GetMatrix());
-    render_info.normal_matrix =
-        Uniform<glm::mat3>(shaders_[index].program(), "normalMatrix", glm::identity<glm::mat3>());
-
-    glGenVertexArrays(1, &render_info.vao);
-    glGenBuffers(1, &render_info.vbo);
-    glGenBuffers(1, &render_info.ebo);
-
-    glBindVertexArray(render_info.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, render_info.vbo);
-    glBufferData(
-        GL_ARRAY_BUFFER,
-        static_cast<GLsizeiptr>(mesh->vertices.size() * sizeof(Mesh::Vertex)),
-        mesh->vertices.data(),
-        GL_STATIC_DRAW
-    );
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render_info.ebo);
-    glBufferData(
-        GL_ELEMENT_ARRAY_BUFFER,
-        static_cast<GLsizeiptr>(mesh->indices.size() * sizeof(GLuint)),
-        mesh->indices.data(),
-        GL_STATIC_DRAW
-    );
+    render_info.geometry = geometry_buffer_->Add(*mesh);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), nullptr);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(
-        1, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), reinterpret_cast<void *>(offsetof(Mesh::Vertex, normal))
-    );
+    scene_->AddComponent(entity, std::move(render_info));
+    index++;
+  }
+  geometry_buffer_->Upload(index);
+
+  // The main pass and the depth pre-pass draw every object at most once.
+  const auto object_count = static_cast<size_t>(index);
+  // Every shadow view draws each object at most once as well, split over a static and a dynamic caster draw.
+  const size_t shadow_views = kDirectionalCascadeCount + scene_->GetAllObjectsWith<SpotLight>().size() +
+      static_cast<size_t>(shadowed_point_lights);
+  frame_buffer_->Reserve(
+      sizeof(MatricesUBOData) + LightsSize(scene_) + kLightSpacesOffset +
+          light_spaces_.size() * sizeof(LightSpaceData) +
+          object_count * (sizeof(DrawData) + 2 * sizeof(DrawElementsIndirectCommand) +
+                          (shadow_views + 1) * sizeof(ShadowInstance)),
+      kFrameAllocationCount + 2 * shadow_views
+  );
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(
-        2, 2, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), reinterpret_cast<void *>(offsetof(Mesh::Vertex, texcoord))
-    );
+  if (settings_.pack_material_textures) {
+    PackMaterialTextures();
+  }
 
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(
-        3, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Vertex), reinterpret_cast<void *>(offsetof(Mesh::Vertex, tangent))
-    );
+  // Resolved after packing, which reorders the textures.
+  absl::flat_hash_map<std::vector<GLuint>, uint32_t> material_indices;
+  for (auto &&[_, render_info] : scene_->GetAllObjectsWith<RenderObject>().each()) {
+    const auto alpha_texture = std::ranges::find(render_info.textures, "alphaTexture", &Texture::name);
+    render_info.shadow_alpha_texture =
+        alpha_texture == render_info.textures.end() ? white_pixel_->texture() : alpha_texture->texture();
 
-    glBindVertexArray(0);
+    std::vector<GLuint> bound_textures;
+    for (const Texture &texture : render_info.textures) {
+      bound_textures.push_back(texture.texture());
+    }
+    for (const TextureLayer &texture_layer : render_info.texture_layers) {
+      bound_textures.push_back(texture_layer.texture_array);
+    }
+    render_info.material_index =
+        material_indices.try_emplace(std::move(bound_textures), static_cast<uint32_t>(material_indices.size()))
+            .first->second;
+  }
 
-    scene_->AddComponent(entity, std::move(render_info));
-    index++;
+  // Objects of one mesh share its material, and with it the texture layers.
+  material_data_.clear();
+  material_data_indices_.clear();
+  dirty_materials_.clear();
+  for (auto &&[_, render_info, mesh] : scene_->GetAllObjectsWith<RenderObject, Mesh *>().each()) {
+    const auto [material_data_index, inserted] =
+        material_data_indices_.try_emplace(&mesh->material, static_cast<uint32_t>(material_data_.size()));
+    render_info.material_data_index = material_data_index->second;
+    if (!inserted) {
+      continue;
+    }
+    MaterialData &material_data = material_data_.emplace_back();
+    SetMaterialParameters(mesh->material, material_data);
+    for (const TextureLayer &texture_layer : render_info.texture_layers) {
+      material_data.textureLayers.at(texture_layer.slot / 4)[texture_layer.slot % 4] = texture_layer.layer;
+    }
   }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, material_buffer_);
+  glBufferData(
+      GL_SHADER_STORAGE_BUFFER,
+      static_cast<GLsizeiptr>(material_data_.size() * sizeof(MaterialData)),
+      material_data_.data(),
+      GL_STATIC_DRAW
+  );
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  SortStaticDraws();
 
   LOG(INFO) << "Finished setup scene";
 }
 
-void Renderer::AttachMaterial(RenderObject &render_object, const Material &material) {
-  std::vector<ShaderFlag> vertex_shader_flags{};
-  std::vector<ShaderFlag> fragment_shader_flags{};
+void Renderer::MarkMaterialDirty(const Material &material) {
+  if (material_data_indices_.contains(&material)) {
+    dirty_materials_.push_back(&material);
+  }
+}
 
-  const std::vector<ShaderFlag> shadow_vertex_shader_flags{};
-  const std::vector<ShaderFlag> shadow_fragment_shader_flags{};
+void Renderer::SetMaterialParameters(const Material &material, MaterialData &material_data) {
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "UnusedValue"
+  material_data.shininess = material.shininess;
+  material_data.opticalDensity = material.optical_density;
+  material_data.dissolve = material.dissolve;
+  material_data.diffuseColor = material.diffuse_color;
+  material_data.ambientColor = material.ambient_color;
+  material_data.specularColor = material.specular_color;
+  material_data.transmissionFilterColor = material.transmission_filter_color;
+#pragma clang diagnostic pop
+}
+
+void Renderer::UploadDirtyMaterials() {
+  if (dirty_materials_.empty()) {
+    return;
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, material_buffer_);
+  for (const Material *material : dirty_materials_) {
+    const uint32_t index = material_data_indices_.at(material);
+    // The texture layers only change with a new scene setup.
+    SetMaterialParameters(*material, material_data_[index]);
+    glBufferSubData(
+        GL_SHADER_STORAGE_BUFFER,
+        static_cast<GLintptr>(index * sizeof(MaterialData)),
+        sizeof(MaterialData),
+        &material_data_[index]
+    );
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  dirty_materials_.clear();
+}
+
+void Renderer::AttachMaterial(RenderObject &render_object, const Material &material) {
+  ShaderVariantKey variant;
 
   if (material.ambient_texture.has_value()) {
     render_object.textures.emplace_back(material.ambient_texture.value(), "ambientTexture", *texture_allocator_);
   }
   else {
-    fragment_shader_flags.emplace_back(ShaderFlagTypes::kNoAmbientTexture, 1);
+    variant = variant.With(ShaderFlagTypes::kNoAmbientTexture);
   }
 
   if (material.diffuse_texture.has_value()) {
     render_object.textures.emplace_back(material.diffuse_texture.value(), "diffuseTexture", *texture_allocator_);
   }
   else {
-    fragment_shader_flags.emplace_back(ShaderFlagTypes::kNoDiffuseTexture, 1);
+    variant = variant.With(ShaderFlagTypes::kNoDiffuseTexture);
   }
 
   if (material.specular_texture.has_value()) {
     render_object.textures.emplace_back(material.specular_texture.value(), "specularTexture", *texture_allocator_);
   }
   else {
-    fragment_shader_flags.emplace_back(ShaderFlagTypes::kNoSpecularTexture, 1);
+    variant = variant.With(ShaderFlagTypes::kNoSpecularTexture);
   }
 
   if (material.shininess_texture.has_value()) {
     render_object.textures.emplace_back(material.shininess_texture.value(), "shininessTexture", *texture_allocator_);
   }
   else {
-    fragment_shader_flags.emplace_back(ShaderFlagTypes::kNoShininessTexture, 1);
+    variant = variant.With(ShaderFlagTypes::kNoShininessTexture);
   }
 
   if (material.alpha_texture.has_value()) {
     render_object.textures.emplace_back(material.alpha_texture.value(), "alphaTexture", *texture_allocator_);
   }
   else {
-    fragment_shader_flags.emplace_back(ShaderFlagTypes::kNoAlphaTexture, 1);
+    variant = variant.With(ShaderFlagTypes::kNoAlphaTexture);
   }
 
   if (material.bump_texture.has_value()) {
     render_object.textures.emplace_back(material.bump_texture.value(), "bumpTexture", *texture_allocator_);
   }
   else {
-    fragment_shader_flags.emplace_back(ShaderFlagTypes::kNoBumpTexture, 1);
+    variant = variant.With(ShaderFlagTypes::kNoBumpTexture);
   }
 
   if (material.displacement_texture.has_value()) {
@@ -687,35 +1690,38 @@ void Renderer::AttachMaterial(RenderObject &render_object, const Material &mater
     );
   }
   else {
-    fragment_shader_flags.emplace_back(ShaderFlagTypes::kNoDisplacementTexture, 1);
+    variant = variant.With(ShaderFlagTypes::kNoDisplacementTexture);
   }
 
-  fragment_shader_flags.emplace_back(
-      ShaderFlagTypes::kPointLightCount, static_cast<int>(scene_->GetAllObjectsWith<PointLight>().size())
-  );
-  fragment_shader_flags.emplace_back(ShaderFlagTypes::kDirectionalLightCount, 1);
-  fragment_shader_flags.emplace_back(
-      ShaderFlagTypes::kSpotLightCount, static_cast<int>(scene_->GetAllObjectsWith<SpotLight>().size())
-  );
+  if (settings_.pack_material_textures) {
+    variant = variant.With(ShaderFlagTypes::kTextureArrays);
+  }
 
-  vertex_shader_flags.emplace_back(
-      ShaderFlagTypes::kPointLightCount, static_cast<int>(scene_->GetAllObjectsWith<PointLight>().size())
-  );
-  vertex_shader_flags.emplace_back(ShaderFlagTypes::kDirectionalLightCount, 1);
-  vertex_shader_flags.emplace_back(
-      ShaderFlagTypes::kSpotLightCount, static_cast<int>(scene_->GetAllObjectsWith<SpotLight>().size())
-  );
+  // Point and spot lights are read from unsized storage blocks, so the shaders only need to know whether there are any
+  // and adding a light does not recompile every variant.
+  variant = variant
+      .With(ShaderFlagTypes::kPointLightCount, scene_->GetAllObjectsWith<PointLight>().empty() ? 0 : 1)
+      .With(ShaderFlagTypes::kDirectionalLightCount, 1)
+      .With(ShaderFlagTypes::kSpotLightCount, scene_->GetAllObjectsWith<SpotLight>().empty() ? 0 : 1);
 
-  shaders_.emplace_back(
-      "shaders/render_shader.vert",
-      vertex_shader_flags,
-      "shaders/render_shader.frag",
-      fragment_shader_flags,
-      *shader_allocator_
-  );
-  shaders_.back().Use();
+  render_object.shader_index = GetShaderVariant(variant);
+}
 
-  render_object.material_data = UniformBuffer(sizeof(MaterialUBOData));
-  render_object.material_data.Bind(shaders_.back().program(), "Material", kMaterialUBOBindingPoint);
+size_t Renderer::GetShaderVariant(ShaderVariantKey key) {
+  const auto [variant_index, inserted] = shader_variant_indices_.try_emplace(key, shader_variants_.size());
+  if (inserted) {
+    shader_variants_.push_back(ShaderVariant{
+        key,
+        Shader("shaders/render_shader.vert",
+               std::vector<ShaderFlag>{},
+               "shaders/render_shader.frag",
+               key.ToFlags(),
+               *shader_allocator_),
+        ProgramReflection(),
+        {},
+        false
+    });
+  }
+  return variant_index->second;
 }
 }  // namespace chove::rendering::opengl
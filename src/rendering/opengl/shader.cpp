@@ -26,7 +26,9 @@ Shader::Shader(const std::filesystem::path &vertex_shader_path,
   program_ = shader_allocator.AllocateShader(vertex_shader_path,
                                              vertex_shader_flags,
                                              fragment_shader_path,
-                                             fragment_shader_flags);
+                                             fragment_shader_flags,
+                                             geometry_shader_path,
+                                             geometry_shader_flags);
 }
 
 
@@ -1,6 +1,10 @@
 #include "rendering/opengl/shader_allocator.h"
 
+#include <cstdint>
+#include <format>
 #include <fstream>
+#include <string_view>
+#include <system_error>
 
 #include <absl/log/log.h>
 
@@ -31,15 +35,84 @@ void LogShaderCompileIssues(GLuint shader) {
   }
 }
 
-void LogShaderLinkIssues(GLuint program) {
+bool LogShaderLinkIssues(GLuint program) {
   GLint success;
   GLchar log[512];
 
   glGetProgramiv(program, GL_LINK_STATUS, &success);
   if (!success) {
-    glGetShaderInfoLog(program, 512, nullptr, log);
+    glGetProgramInfoLog(program, 512, nullptr, log);
     LOG(ERROR) << "Shader linking error: " << log;
   }
+  return success;
+}
+
+const char *StageName(GLenum type) {
+  switch (type) {
+    case GL_VERTEX_SHADER:return "vertex";
+    case GL_FRAGMENT_SHADER:return "fragment";
+    case GL_GEOMETRY_SHADER:return "geometry";
+    default:return "unknown";
+  }
+}
+
+// Stable across runs, unlike absl::Hash, so it can name files in the binary cache.
+uint64_t Fnv1a(std::string_view data) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Binary cache files hold the binary format followed by the driver specific program binary.
+bool LoadProgramBinary(GLuint program, const std::filesystem::path &path) {
+  std::error_code error;
+  const std::uintmax_t file_size = std::filesystem::file_size(path, error);
+  if (error || file_size <= sizeof(GLenum)) {
+    return false;
+  }
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    return false;
+  }
+  GLenum binary_format = 0;
+  input.read(reinterpret_cast<char *>(&binary_format), sizeof(binary_format));
+  std::vector<char> binary(file_size - sizeof(binary_format));
+  input.read(binary.data(), static_cast<std::streamsize>(binary.size()));
+  if (input.gcount() != static_cast<std::streamsize>(binary.size())) {
+    return false;
+  }
+
+  glProgramBinary(program, binary_format, binary.data(), static_cast<GLsizei>(binary.size()));
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    // Driver updates invalidate binaries without changing the version string on some platforms.
+    LOG(INFO) << "Program binary " << path << " was rejected by the driver, compiling from source";
+    return false;
+  }
+  LOG(INFO) << "Loaded program binary " << path;
+  return true;
+}
+
+void SaveProgramBinary(GLuint program, const std::filesystem::path &path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length == 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  GLenum binary_format = 0;
+  glGetProgramBinary(program, length, nullptr, &binary_format, binary.data());
+
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  output.write(reinterpret_cast<const char *>(&binary_format), sizeof(binary_format));
+  output.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+  if (!output) {
+    LOG(WARNING) << "Failed to write program binary " << path;
+  }
 }
 
 std::vector<std::string> GetDefinesForFlags(std::vector<ShaderFlag> flags) {
@@ -69,25 +142,50 @@ std::vector<std::string> GetDefinesForFlags(std::vector<ShaderFlag> flags) {
       case ShaderFlagTypes::kSpotLightCount:
         result.emplace_back("#define SPOT_LIGHT_COUNT " + std::to_string(flag.value) + "\n");
         break;
+      case ShaderFlagTypes::kTextureArrays:result.emplace_back("#define TEXTURE_ARRAYS\n");
+        break;
     }
   }
   return result;
 }
 
-std::string StringifyFlags(std::vector<ShaderFlag> flags) {
-  std::string result;
-  std::sort(flags.begin(), flags.end());  // sort so that the order of flags doesn't matter
-  for (const ShaderFlag &flag : flags) {
-    result += std::to_string(static_cast<int>(flag.type)) + ":" + std::to_string(flag.value) + ",";
-  }
-  return result;
-}
+constexpr const char *kShaderVersion = "#version 430 core\n";
 
-constexpr const char *kShaderVersion = "#version 420 core\n";
+}
 
+ShaderAllocator::ShaderAllocator(std::filesystem::path binary_cache_directory) :
+    binary_cache_directory_(std::move(binary_cache_directory)) {
+  GLint binary_format_count = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_format_count);
+  if (binary_format_count == 0 && !binary_cache_directory_.empty()) {
+    LOG(WARNING) << "The driver does not support program binaries, shaders will be compiled on every start";
+    binary_cache_directory_.clear();
+  }
+  if (GLEW_KHR_parallel_shader_compile) {
+    // Let the driver pick the number of compiler threads.
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    parallel_compile_ = true;
+  }
+  else if (GLEW_ARB_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    parallel_compile_ = true;
+  }
+  if (!binary_cache_directory_.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(binary_cache_directory_, error);
+    // Programs built by another driver cannot be loaded, so the driver is part of every cache key.
+    driver_identifier_ = std::string(reinterpret_cast<const char *>(glGetString(GL_VENDOR))) + "\n" +
+        reinterpret_cast<const char *>(glGetString(GL_RENDERER)) + "\n" +
+        reinterpret_cast<const char *>(glGetString(GL_VERSION)) + "\n";
+  }
 }
 
 ShaderAllocator::~ShaderAllocator() {
+  for (auto &[_, pending] : pending_programs_) {
+    for (const GLuint shader : pending.shaders) {
+      glDeleteShader(shader);
+    }
+  }
   std::vector<GLuint> shaders;
   for (auto &[shader, _] : shader_ref_counts) {
     glDeleteProgram(shader);
@@ -98,80 +196,30 @@ GLuint ShaderAllocator::AllocateShader(const std::filesystem::path &vertex_shade
                                        const std::vector<ShaderFlag> &vertex_shader_flags,
                                        const std::filesystem::path &fragment_shader_path,
                                        const std::vector<ShaderFlag> &fragment_shader_flags) {
-  ShaderInfo info = {vertex_shader_path, StringifyFlags(vertex_shader_flags), fragment_shader_path,
-                     StringifyFlags(fragment_shader_flags)};
-
-  if (shader_creation_cache_.contains(info) && shader_ref_counts.contains(shader_creation_cache_.at(info))) {
-    // second check is needed because the shader might have been deallocated
-    shader_ref_counts.at(shader_creation_cache_.at(info)) += 1;
-    return shader_creation_cache_.at(info);
-  }
-
-  LOG(INFO) << "Reading vertex shader from " << vertex_shader_path;
-  GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-
-  std::vector<const GLchar *> sources;
-  std::vector<GLint> lengths;
-  std::vector<std::string> defines = GetDefinesForFlags(vertex_shader_flags);
-  std::string shader_source = ReadFile(vertex_shader_path);
-  sources.push_back(kShaderVersion);
-  lengths.push_back(static_cast<GLint>(strlen(kShaderVersion)));
-  for (const std::string &define : defines) {
-    sources.push_back(define.c_str());
-    lengths.push_back(static_cast<GLint>(define.size()));
-  }
-  sources.push_back(shader_source.c_str());
-  lengths.push_back(static_cast<GLint>(shader_source.size()));
-  glShaderSource(vertex_shader, static_cast<GLsizei>(sources.size()), sources.data(), lengths.data());
-
-  glCompileShader(vertex_shader);
-  LogShaderCompileIssues(vertex_shader);
-  LOG(INFO) << "Compiled vertex shader";
-
-  LOG(INFO) << "Reading fragment shader from " << fragment_shader_path;
-  GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-
-  sources.clear();
-  lengths.clear();
-  defines = GetDefinesForFlags(fragment_shader_flags);
-  shader_source = ReadFile(fragment_shader_path);
-  sources.push_back(kShaderVersion);
-  lengths.push_back(static_cast<GLint>(strlen(kShaderVersion)));
-  for (const std::string &define : defines) {
-    sources.push_back(define.c_str());
-    lengths.push_back(static_cast<GLint>(define.size()));
-  }
-  sources.push_back(shader_source.c_str());
-  lengths.push_back(static_cast<GLint>(shader_source.size()));
-  glShaderSource(fragment_shader, static_cast<GLsizei>(sources.size()), sources.data(), lengths.data());
-
-  glCompileShader(fragment_shader);
-  LogShaderCompileIssues(fragment_shader);
-  LOG(INFO) << "Compiled fragment shader";
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vertex_shader);
-  glAttachShader(program, fragment_shader);
-  glLinkProgram(program);
-  LogShaderLinkIssues(program);
-
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
-
-  shader_creation_cache_[info] = program;
-  shader_ref_counts[program] = 1;
-  return program;
+  return AllocateProgram({
+      StageInfo{GL_VERTEX_SHADER, vertex_shader_path, vertex_shader_flags},
+      StageInfo{GL_FRAGMENT_SHADER, fragment_shader_path, fragment_shader_flags},
+  });
 }
 
-
 GLuint ShaderAllocator::AllocateShader(const std::filesystem::path &vertex_shader_path,
                                        const std::vector<ShaderFlag> &vertex_shader_flags,
                                        const std::filesystem::path &fragment_shader_path,
                                        const std::vector<ShaderFlag> &fragment_shader_flags,
                                        const std::filesystem::path &geometry_shader_path,
                                        const std::vector<ShaderFlag> &geometry_shader_flags) {
-  ShaderInfo info = {vertex_shader_path, StringifyFlags(vertex_shader_flags), fragment_shader_path,
-                     StringifyFlags(fragment_shader_flags)};
+  return AllocateProgram({
+      StageInfo{GL_VERTEX_SHADER, vertex_shader_path, vertex_shader_flags},
+      StageInfo{GL_FRAGMENT_SHADER, fragment_shader_path, fragment_shader_flags},
+      StageInfo{GL_GEOMETRY_SHADER, geometry_shader_path, geometry_shader_flags},
+  });
+}
+
+GLuint ShaderAllocator::AllocateProgram(const std::vector<StageInfo> &stages) {
+  ShaderInfo info;
+  for (const StageInfo &stage : stages) {
+    info.stages.emplace_back(stage.type, stage.path, ShaderVariantKey(stage.flags).bits());
+  }
 
   if (shader_creation_cache_.contains(info) && shader_ref_counts.contains(shader_creation_cache_.at(info))) {
     // second check is needed because the shader might have been deallocated
@@ -179,90 +227,103 @@ GLuint ShaderAllocator::AllocateShader(const std::filesystem::path &vertex_shade
     return shader_creation_cache_.at(info);
   }
 
-  LOG(INFO) << "Reading vertex shader from " << vertex_shader_path;
-  GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-
-  std::vector<const GLchar *> sources;
-  std::vector<GLint> lengths;
-  std::vector<std::string> defines = GetDefinesForFlags(vertex_shader_flags);
-  std::string shader_source = ReadFile(vertex_shader_path);
-  sources.push_back(kShaderVersion);
-  lengths.push_back(static_cast<GLint>(strlen(kShaderVersion)));
-  for (const std::string &define : defines) {
-    sources.push_back(define.c_str());
-    lengths.push_back(static_cast<GLint>(define.size()));
-  }
-  sources.push_back(shader_source.c_str());
-  lengths.push_back(static_cast<GLint>(shader_source.size()));
-  glShaderSource(vertex_shader, static_cast<GLsizei>(sources.size()), sources.data(), lengths.data());
-
-  glCompileShader(vertex_shader);
-  LogShaderCompileIssues(vertex_shader);
-  LOG(INFO) << "Compiled vertex shader";
-
-  LOG(INFO) << "Reading fragment shader from " << fragment_shader_path;
-  GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-
-  sources.clear();
-  lengths.clear();
-  defines = GetDefinesForFlags(fragment_shader_flags);
-  shader_source = ReadFile(fragment_shader_path);
-  sources.push_back(kShaderVersion);
-  lengths.push_back(static_cast<GLint>(strlen(kShaderVersion)));
-  for (const std::string &define : defines) {
-    sources.push_back(define.c_str());
-    lengths.push_back(static_cast<GLint>(define.size()));
-  }
-  sources.push_back(shader_source.c_str());
-  lengths.push_back(static_cast<GLint>(shader_source.size()));
-  glShaderSource(fragment_shader, static_cast<GLsizei>(sources.size()), sources.data(), lengths.data());
-
-  glCompileShader(fragment_shader);
-  LogShaderCompileIssues(fragment_shader);
-  LOG(INFO) << "Compiled fragment shader";
-
-
-  LOG(INFO) << "Reading geometry shader from " << vertex_shader_path;
-  GLuint geometry_shader = glCreateShader(GL_GEOMETRY_SHADER);
-
-  sources.clear();
-  lengths.clear();
-  defines = GetDefinesForFlags(geometry_shader_flags);
-  shader_source = ReadFile(geometry_shader_path);
-  sources.push_back(kShaderVersion);
-  lengths.push_back(static_cast<GLint>(strlen(kShaderVersion)));
-  for (const std::string &define : defines) {
-    sources.push_back(define.c_str());
-    lengths.push_back(static_cast<GLint>(define.size()));
+  std::vector<std::string> sources;
+  std::string cache_key = driver_identifier_;
+  for (const StageInfo &stage : stages) {
+    LOG(INFO) << "Reading " << StageName(stage.type) << " shader from " << stage.path;
+    std::string source = kShaderVersion;
+    for (const std::string &define : GetDefinesForFlags(stage.flags)) {
+      source += define;
+    }
+    source += ReadFile(stage.path);
+    cache_key += std::to_string(stage.type) + "\n" + source;
+    sources.push_back(std::move(source));
   }
-  sources.push_back(shader_source.c_str());
-  lengths.push_back(static_cast<GLint>(shader_source.size()));
-  glShaderSource(geometry_shader, static_cast<GLsizei>(sources.size()), sources.data(), lengths.data());
-
-  glCompileShader(geometry_shader);
-  LogShaderCompileIssues(geometry_shader);
-  LOG(INFO) << "Compiled geometry shader";
 
   GLuint program = glCreateProgram();
-  glAttachShader(program, vertex_shader);
-  glAttachShader(program, fragment_shader);
-  glAttachShader(program, geometry_shader);
-  glLinkProgram(program);
-  LogShaderLinkIssues(program);
+  const std::filesystem::path binary_path = binary_cache_directory_.empty()
+      ? std::filesystem::path()
+      : binary_cache_directory_ / std::format("{:016x}.bin", Fnv1a(cache_key));
+
+  if (binary_path.empty() || !LoadProgramBinary(program, binary_path)) {
+    // Only submit the work here: querying any status would wait for the driver, so the logs and the binary are
+    // collected in FinishProgram once the program is ready.
+    PendingProgram pending{.shaders = {}, .binary_path = binary_path};
+    for (size_t i = 0; i < stages.size(); ++i) {
+      GLuint shader = glCreateShader(stages[i].type);
+      const GLchar *source = sources[i].c_str();
+      const auto length = static_cast<GLint>(sources[i].size());
+      glShaderSource(shader, 1, &source, &length);
+      glCompileShader(shader);
+      glAttachShader(program, shader);
+      pending.shaders.push_back(shader);
+    }
 
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
-  glDeleteShader(geometry_shader);
+    if (!binary_path.empty()) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
+    pending_programs_.emplace(program, std::move(pending));
+  }
 
   shader_creation_cache_[info] = program;
   shader_ref_counts[program] = 1;
   return program;
 }
 
+bool ShaderAllocator::IsReady(GLuint program) {
+  const auto pending = pending_programs_.find(program);
+  if (pending == pending_programs_.end()) {
+    return true;
+  }
+  if (parallel_compile_) {
+    GLint completed = GL_FALSE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+    if (completed == GL_FALSE) {
+      return false;
+    }
+  }
+  // Without the extension there is no way to poll, so the first query waits for the program.
+  FinishProgram(program, pending->second);
+  pending_programs_.erase(pending);
+  return true;
+}
+
+void ShaderAllocator::WaitUntilReady(GLuint program) {
+  const auto pending = pending_programs_.find(program);
+  if (pending != pending_programs_.end()) {
+    FinishProgram(program, pending->second);
+    pending_programs_.erase(pending);
+  }
+}
+
+void ShaderAllocator::FinishProgram(GLuint program, const PendingProgram &pending) {
+  for (const GLuint shader : pending.shaders) {
+    LogShaderCompileIssues(shader);
+  }
+  const bool linked = LogShaderLinkIssues(program);
+  LOG(INFO) << "Linked shader program " << program;
+
+  for (const GLuint shader : pending.shaders) {
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+  }
+
+  if (linked && !pending.binary_path.empty()) {
+    SaveProgramBinary(program, pending.binary_path);
+  }
+}
+
 void ShaderAllocator::DeallocateShader(GLuint shader) {
   shader_ref_counts.at(shader) -= 1;
   if (shader_ref_counts.at(shader) == 0) {
     shader_ref_counts.erase(shader);
+    if (pending_programs_.contains(shader)) {
+      for (const GLuint stage : pending_programs_.at(shader).shaders) {
+        glDeleteShader(stage);
+      }
+      pending_programs_.erase(shader);
+    }
     glDeleteProgram(shader);
   }
 }
@@ -0,0 +1,56 @@
+#include "rendering/opengl/shadow_atlas.h"
+
+#include <bit>
+
+namespace chove::rendering::opengl {
+
+ShadowAtlas::ShadowAtlas(int size) : size_(size) {
+  Clear();
+}
+
+std::optional<ShadowAtlas::Tile> ShadowAtlas::Allocate(int size) {
+  if (size <= 0 || size > size_ || !std::has_single_bit(static_cast<unsigned>(size))) {
+    return std::nullopt;
+  }
+  const auto level = static_cast<size_t>(std::countr_zero(static_cast<unsigned>(size_ / size)));
+  if (free_tiles_.size() <= level) {
+    free_tiles_.resize(level + 1);
+  }
+
+  // Smallest free tile at least as large as the request.
+  size_t free_level = level;
+  while (free_tiles_[free_level].empty()) {
+    if (free_level == 0) {
+      return std::nullopt;
+    }
+    free_level--;
+  }
+
+  Tile tile = free_tiles_[free_level].back();
+  free_tiles_[free_level].pop_back();
+  // Keeps the first quarter at every split and frees the other three.
+  while (free_level < level) {
+    free_level++;
+    tile.size /= 2;
+    free_tiles_[free_level].push_back(Tile{tile.x + tile.size, tile.y, tile.size});
+    free_tiles_[free_level].push_back(Tile{tile.x, tile.y + tile.size, tile.size});
+    free_tiles_[free_level].push_back(Tile{tile.x + tile.size, tile.y + tile.size, tile.size});
+  }
+  return tile;
+}
+
+void ShadowAtlas::Clear() {
+  free_tiles_.assign(1, {Tile{0, 0, size_}});
+}
+
+glm::vec4 ShadowAtlas::UvRect(const Tile &tile) const {
+  const float atlas_size = static_cast<float>(size_);
+  return {
+      static_cast<float>(tile.size) / atlas_size,
+      static_cast<float>(tile.size) / atlas_size,
+      static_cast<float>(tile.x) / atlas_size,
+      static_cast<float>(tile.y) / atlas_size
+  };
+}
+
+}  // namespace chove::rendering::opengl
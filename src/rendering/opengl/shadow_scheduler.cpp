@@ -0,0 +1,67 @@
+#include "rendering/opengl/shadow_scheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace chove::rendering::opengl {
+
+void ShadowScheduler::Request(entt::entity light, float importance, int face_cost) {
+  const auto [state, inserted] = lights_.try_emplace(light, LightState{});
+  state->second.importance = importance;
+  state->second.face_cost = face_cost;
+  state->second.requested = true;
+}
+
+void ShadowScheduler::Schedule() {
+  frame_++;
+
+  std::vector<std::pair<float, LightState *>> candidates;
+  for (auto &[light, state] : lights_) {
+    state.scheduled = false;
+    if (!state.requested) {
+      continue;
+    }
+    state.requested = false;
+    const float priority = state.rendered
+        ? state.importance * static_cast<float>(frame_ - state.last_update_frame)
+        : std::numeric_limits<float>::infinity();
+    candidates.emplace_back(priority, &state);
+  }
+  std::ranges::sort(candidates, std::greater{}, &std::pair<float, LightState *>::first);
+
+  int remaining_budget = face_budget_;
+  scheduled_count_ = 0;
+  for (const auto &[priority, state] : candidates) {
+    const bool never_rendered = !state->rendered;
+    if (scheduled_count_ > 0 && !never_rendered && state->face_cost > remaining_budget) {
+      continue;
+    }
+    remaining_budget -= state->face_cost;
+    state->scheduled = true;
+    state->rendered = true;
+    state->last_update_frame = frame_;
+    scheduled_count_++;
+  }
+
+  max_staleness_ = 0;
+  for (const auto &[priority, state] : candidates) {
+    max_staleness_ = std::max(max_staleness_, frame_ - state->last_update_frame);
+  }
+}
+
+bool ShadowScheduler::ShouldUpdate(entt::entity light) const {
+  const auto state = lights_.find(light);
+  return state != lights_.end() && state->second.scheduled;
+}
+
+uint64_t ShadowScheduler::Staleness(entt::entity light) const {
+  const auto state = lights_.find(light);
+  if (state == lights_.end() || !state->second.rendered) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return frame_ - state->second.last_update_frame;
+}
+
+}  // namespace chove::rendering::opengl
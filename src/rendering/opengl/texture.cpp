@@ -43,5 +43,16 @@ Texture::Texture(int cube_length, std::string name, TextureAllocator &allocator)
                                                                                    allocator_(&allocator) {
   texture_ = allocator_->AllocateCubeDepthMap(cube_length);
 }
+
+Texture::Texture(GLuint texture, std::string name, TextureAllocator &allocator)
+    : texture_(texture), name_(std::move(name)), allocator_(&allocator) {}
+
+Texture Texture::CubeDepthMapArray(int cube_length, int cube_count, std::string name, TextureAllocator &allocator) {
+  return Texture(allocator.AllocateCubeDepthMapArray(cube_length, cube_count), std::move(name), allocator);
+}
+
+Texture Texture::CubeDepthMapView(const Texture &cube_array, int cube, std::string name, TextureAllocator &allocator) {
+  return Texture(allocator.AllocateCubeDepthMapView(cube_array.texture(), cube), std::move(name), allocator);
+}
 }
 
@@ -1,14 +1,34 @@
 #include "rendering/opengl/texture_allocator.h"
 
-#include "external/stb_image.h"
 #include <absl/log/log.h>
 
+#include <algorithm>
+
 namespace chove::rendering::opengl {
 namespace {
 constexpr int kTexturesPerAllocation = 64;
+
+// Streamed textures start with only the levels at most this large resident, the streamer brings in the rest.
+constexpr int kInitialResidentSize = 64;
+
+// Point light shadow maps are copied between their cube in the shadow map array and the cube of their static cache,
+// which needs both to have the same sized format.
+constexpr GLenum kCubeDepthMapFormat = GL_DEPTH_COMPONENT24;
+
+void SetCubeDepthMapParameters(GLenum target) {
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  float borderColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
+  glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, borderColor);
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 }
+}  // namespace
 
-TextureAllocator::TextureAllocator() {
+TextureAllocator::TextureAllocator(size_t memory_budget, bool compress_textures) :
+    memory_budget_(memory_budget), compress_textures_(compress_textures) {
   AllocateUnmappedTextureBlockIfNeeded();
 }
 
@@ -36,10 +56,165 @@ void TextureAllocator::DeallocateTexture(GLuint texture) {
   texture_ref_counts_.at(texture) -= 1;
   if (texture_ref_counts_.at(texture) == 0) {
     texture_ref_counts_.erase(texture);
+    if (streamed_textures_.contains(texture)) {
+      resident_bytes_ -= MipChainBytes(texture, streamed_textures_.at(texture).resident_base_level);
+      streamed_textures_.erase(texture);
+    }
     glDeleteTextures(1, &texture);
   }
 }
 
+int TextureAllocator::MipLevelCount(GLuint texture) const {
+  return static_cast<int>(streamed_textures_.at(texture).mip_levels().size());
+}
+
+int TextureAllocator::ResidentBaseLevel(GLuint texture) const {
+  return streamed_textures_.at(texture).resident_base_level;
+}
+
+int TextureAllocator::Width(GLuint texture) const {
+  return streamed_textures_.at(texture).mip_levels().front().width;
+}
+
+int TextureAllocator::Height(GLuint texture) const {
+  return streamed_textures_.at(texture).mip_levels().front().height;
+}
+
+std::span<const uint8_t> TextureAllocator::MipLevelData(GLuint texture, int level) const {
+  return streamed_textures_.at(texture).mip_levels().at(level).data;
+}
+
+GLenum TextureAllocator::InternalFormat(GLuint texture) const {
+  return streamed_textures_.at(texture).baked.internal_format();
+}
+
+bool TextureAllocator::IsCompressed(GLuint texture) const {
+  return streamed_textures_.at(texture).baked.compressed();
+}
+
+size_t TextureAllocator::MipChainBytes(GLuint texture, int base_level) const {
+  const StreamedTexture &streamed_texture = streamed_textures_.at(texture);
+  size_t bytes = 0;
+  for (int level = base_level; level < static_cast<int>(streamed_texture.mip_levels().size()); ++level) {
+    bytes += streamed_texture.mip_levels()[level].data.size();
+  }
+  return bytes;
+}
+
+void TextureAllocator::SetResidentBaseLevel(GLuint texture, int base_level) {
+  StreamedTexture &streamed_texture = streamed_textures_.at(texture);
+  base_level = std::clamp(base_level, 0, static_cast<int>(streamed_texture.mip_levels().size()) - 1);
+  UpdateResidentLevels(texture, streamed_texture, base_level);
+}
+
+bool TextureAllocator::IsEvicted(GLuint texture) const {
+  const StreamedTexture &streamed_texture = streamed_textures_.at(texture);
+  return streamed_texture.resident_base_level == static_cast<int>(streamed_texture.mip_levels().size());
+}
+
+void TextureAllocator::MarkUsed(GLuint texture, uint64_t frame) {
+  const auto streamed_texture = streamed_textures_.find(texture);
+  if (streamed_texture == streamed_textures_.end()) {
+    return;
+  }
+  streamed_texture->second.last_used_frame = frame;
+  if (IsEvicted(texture)) {
+    // Bring back the coarsest level only, the streamer refines it over the next frames.
+    UpdateResidentLevels(
+        texture, streamed_texture->second, static_cast<int>(streamed_texture->second.mip_levels().size()) - 1
+    );
+  }
+}
+
+void TextureAllocator::EnforceMemoryBudget(uint64_t current_frame) {
+  if (resident_bytes_ <= memory_budget_) {
+    return;
+  }
+
+  std::vector<std::pair<uint64_t, GLuint>> eviction_candidates;
+  for (const auto &[texture, streamed_texture] : streamed_textures_) {
+    if (streamed_texture.last_used_frame < current_frame && !IsEvicted(texture)) {
+      eviction_candidates.emplace_back(streamed_texture.last_used_frame, texture);
+    }
+  }
+  std::ranges::sort(eviction_candidates);
+
+  for (const auto &[_, texture] : eviction_candidates) {
+    if (resident_bytes_ <= memory_budget_) {
+      break;
+    }
+    StreamedTexture &streamed_texture = streamed_textures_.at(texture);
+    UpdateResidentLevels(texture, streamed_texture, static_cast<int>(streamed_texture.mip_levels().size()));
+  }
+
+  LOG_IF(WARNING, resident_bytes_ > memory_budget_)
+      << "Textures sampled in the current frame take " << resident_bytes_ << " bytes, over the budget of "
+      << memory_budget_ << " bytes";
+}
+
+void TextureAllocator::UploadMipLevel(const StreamedTexture &streamed_texture, int level) {
+  // The levels point into the mapped baked file, so the driver copies straight from the page cache.
+  const BakedTexture::MipLevel &mip_level = streamed_texture.mip_levels()[level];
+  if (streamed_texture.baked.compressed()) {
+    glCompressedTexImage2D(GL_TEXTURE_2D,
+                           level,
+                           streamed_texture.baked.internal_format(),
+                           mip_level.width,
+                           mip_level.height,
+                           0,
+                           static_cast<GLsizei>(mip_level.data.size()),
+                           mip_level.data.data());
+  }
+  else {
+    glTexImage2D(GL_TEXTURE_2D,
+                 level,
+                 GL_SRGB,
+                 mip_level.width,
+                 mip_level.height,
+                 0,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 mip_level.data.data());
+  }
+}
+
+void TextureAllocator::UpdateResidentLevels(GLuint texture, StreamedTexture &streamed_texture, int base_level) {
+  const int current_base_level = streamed_texture.resident_base_level;
+  if (base_level == current_base_level) {
+    return;
+  }
+
+  resident_bytes_ -= MipChainBytes(texture, current_base_level);
+  resident_bytes_ += MipChainBytes(texture, base_level);
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  if (base_level < current_base_level) {
+    for (int level = base_level; level < current_base_level; ++level) {
+      UploadMipLevel(streamed_texture, level);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+  }
+  else {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+    for (int level = current_base_level; level < base_level; ++level) {
+      // Redefining a level with an empty image releases its storage, the texture stays complete because only the
+      // levels from GL_TEXTURE_BASE_LEVEL onwards are considered.
+      glTexImage2D(GL_TEXTURE_2D,
+                   level,
+                   static_cast<GLint>(streamed_texture.baked.internal_format()),
+                   0,
+                   0,
+                   0,
+                   GL_RGBA,
+                   GL_UNSIGNED_BYTE,
+                   nullptr);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  streamed_texture.resident_base_level = base_level;
+}
+
 GLuint TextureAllocator::AllocateTexture(const std::filesystem::path &path) {
   if (texture_creation_cache_.contains(path) && texture_ref_counts_.contains(texture_creation_cache_.at(path))) {
     // second check is needed because the texture might have been deallocated
@@ -47,38 +222,30 @@ GLuint TextureAllocator::AllocateTexture(const std::filesystem::path &path) {
     return texture_creation_cache_.at(path);
   }
 
-  AllocateUnmappedTextureBlockIfNeeded();
-  GLuint texture = unmapped_textures_.back();
-  unmapped_textures_.pop_back();
-
-  int width, height, channels;
-  stbi_uc *image_data = stbi_load(path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
-  if (image_data == nullptr) {
-    LOG(ERROR) << "Failed to load texture " << path;
+  std::optional<BakedTexture> baked = BakedTexture::Load(path, compress_textures_);
+  if (!baked.has_value()) {
     return -1;
   }
 
-  if ((width & (width - 1)) != 0 || (height & (height - 1)) != 0) {
-    LOG(ERROR) << "Texture " << path << " is not a power of two";
-    return -1;
-  }
+  AllocateUnmappedTextureBlockIfNeeded();
+  GLuint texture = unmapped_textures_.back();
+  unmapped_textures_.pop_back();
 
-  // Flip the image vertically because OpenGL expects the origin to be in the bottom left corner
-  int bytes_per_row = width * 4;
-  std::vector<char> buffer(bytes_per_row);
-  int half_height = height / 2;
-  for (int row = 0; row < half_height; ++row) {
-    stbi_uc *row0 = image_data + row * bytes_per_row;
-    stbi_uc *row1 = image_data + (height - row - 1) * bytes_per_row;
-    memcpy(buffer.data(), row0, bytes_per_row);
-    memcpy(row0, row1, bytes_per_row);
-    memcpy(row1, buffer.data(), bytes_per_row);
+  StreamedTexture streamed_texture{.baked = std::move(*baked), .resident_base_level = 0, .last_used_frame = 0};
+  const auto level_count = static_cast<int>(streamed_texture.mip_levels().size());
+  while (streamed_texture.resident_base_level + 1 < level_count &&
+      std::max(streamed_texture.mip_levels()[streamed_texture.resident_base_level].width,
+               streamed_texture.mip_levels()[streamed_texture.resident_base_level].height) > kInitialResidentSize) {
+    streamed_texture.resident_base_level++;
   }
 
   glBindTexture(GL_TEXTURE_2D, texture);
 
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  for (int level = streamed_texture.resident_base_level; level < level_count; ++level) {
+    UploadMipLevel(streamed_texture, level);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, streamed_texture.resident_base_level);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -86,10 +253,10 @@ GLuint TextureAllocator::AllocateTexture(const std::filesystem::path &path) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glBindTexture(GL_TEXTURE_2D, 0);
 
-  stbi_image_free(image_data);
-
   texture_ref_counts_[texture] = 1;
   texture_creation_cache_[path] = texture;
+  streamed_textures_.emplace(texture, std::move(streamed_texture));
+  resident_bytes_ += MipChainBytes(texture, streamed_textures_.at(texture).resident_base_level);
 
   return texture;
 }
@@ -123,28 +290,36 @@ GLuint TextureAllocator::AllocateCubeDepthMap(int cube_length) {
   unmapped_textures_.pop_back();
 
   glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+  glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, kCubeDepthMapFormat, cube_length, cube_length);
+  SetCubeDepthMapParameters(GL_TEXTURE_CUBE_MAP);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-  for (int i = 0; i < 6; ++i) {
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                 0,
-                 GL_DEPTH_COMPONENT,
-                 cube_length,
-                 cube_length,
-                 0,
-                 GL_DEPTH_COMPONENT,
-                 GL_FLOAT,
-                 nullptr);
-  }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  float borderColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
-  glTexParameterfv(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BORDER_COLOR, borderColor);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  texture_ref_counts_[texture] = 1;
+  return texture;
+}
 
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+GLuint TextureAllocator::AllocateCubeDepthMapArray(int cube_length, int cube_count) {
+  AllocateUnmappedTextureBlockIfNeeded();
+  GLuint texture = unmapped_textures_.back();
+  unmapped_textures_.pop_back();
+
+  glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, texture);
+  // Views need immutable storage, every cube takes six layers.
+  glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 1, kCubeDepthMapFormat, cube_length, cube_length, 6 * cube_count);
+  SetCubeDepthMapParameters(GL_TEXTURE_CUBE_MAP_ARRAY);
+  glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+  texture_ref_counts_[texture] = 1;
+  return texture;
+}
+
+GLuint TextureAllocator::AllocateCubeDepthMapView(GLuint cube_array, int cube) {
+  // A view must be created from a name that was never bound, which the unmapped textures are.
+  AllocateUnmappedTextureBlockIfNeeded();
+  GLuint texture = unmapped_textures_.back();
+  unmapped_textures_.pop_back();
+
+  glTextureView(texture, GL_TEXTURE_CUBE_MAP, cube_array, kCubeDepthMapFormat, 0, 1, 6 * cube, 6);
 
   texture_ref_counts_[texture] = 1;
   return texture;
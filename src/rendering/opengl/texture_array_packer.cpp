@@ -0,0 +1,115 @@
+#include "rendering/opengl/texture_array_packer.h"
+
+#include <algorithm>
+#include <span>
+
+#include <absl/log/log.h>
+
+namespace chove::rendering::opengl {
+
+TextureArrayPacker::TextureArrayPacker(TextureAllocator &allocator) : allocator_(&allocator) {}
+
+TextureArrayPacker::~TextureArrayPacker() { Clear(); }
+
+void TextureArrayPacker::AddTexture(GLuint texture) {
+  if (!allocator_->IsStreamed(texture) || layers_.contains(texture)) {
+    return;
+  }
+  std::vector<GLuint> &textures = pending_textures_[ArrayFormat{
+      allocator_->Width(texture), allocator_->Height(texture), allocator_->InternalFormat(texture)
+  }];
+  if (std::ranges::find(textures, texture) == textures.end()) {
+    textures.push_back(texture);
+  }
+}
+
+void TextureArrayPacker::Pack() {
+  for (const auto &[format, textures] : pending_textures_) {
+    GLuint texture_array = 0;
+    glGenTextures(1, &texture_array);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+
+    const int level_count = allocator_->MipLevelCount(textures.front());
+    for (int level = 0; level < level_count; ++level) {
+      const int level_width = std::max(1, format.width >> level);
+      const int level_height = std::max(1, format.height >> level);
+      const auto layer_count = static_cast<GLsizei>(textures.size());
+      if (allocator_->IsCompressed(textures.front())) {
+        const std::span<const uint8_t> first_layer = allocator_->MipLevelData(textures.front(), level);
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY,
+                               level,
+                               format.internal_format,
+                               level_width,
+                               level_height,
+                               layer_count,
+                               0,
+                               static_cast<GLsizei>(first_layer.size()) * layer_count,
+                               nullptr);
+        for (int layer = 0; layer < layer_count; ++layer) {
+          const std::span<const uint8_t> data = allocator_->MipLevelData(textures[layer], level);
+          glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+                                    level,
+                                    0,
+                                    0,
+                                    layer,
+                                    level_width,
+                                    level_height,
+                                    1,
+                                    format.internal_format,
+                                    static_cast<GLsizei>(data.size()),
+                                    data.data());
+        }
+        continue;
+      }
+
+      glTexImage3D(GL_TEXTURE_2D_ARRAY,
+                   level,
+                   GL_SRGB,
+                   level_width,
+                   level_height,
+                   layer_count,
+                   0,
+                   GL_RGBA,
+                   GL_UNSIGNED_BYTE,
+                   nullptr);
+      for (int layer = 0; layer < layer_count; ++layer) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+                        level,
+                        0,
+                        0,
+                        layer,
+                        level_width,
+                        level_height,
+                        1,
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        allocator_->MipLevelData(textures[layer], level).data());
+      }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    for (int layer = 0; layer < static_cast<int>(textures.size()); ++layer) {
+      layers_[textures[layer]] = Layer{texture_array, layer};
+    }
+    texture_arrays_.push_back(texture_array);
+
+    LOG(INFO) << "Packed " << textures.size() << " textures of size " << format.width << "x" << format.height
+              << " into a texture array";
+  }
+  pending_textures_.clear();
+}
+
+void TextureArrayPacker::Clear() {
+  glDeleteTextures(static_cast<GLsizei>(texture_arrays_.size()), texture_arrays_.data());
+  texture_arrays_.clear();
+  layers_.clear();
+  pending_textures_.clear();
+}
+
+}  // namespace chove::rendering::opengl
@@ -0,0 +1,116 @@
+#include "rendering/opengl/texture_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+namespace chove::rendering::opengl {
+
+namespace {
+// Textures that nothing requested in a frame fall back to the levels at most this large.
+constexpr int kIdleTextureSize = 64;
+}  // namespace
+
+TextureStreamer::TextureStreamer(TextureAllocator &allocator, size_t memory_budget, int mip_uploads_per_frame) :
+    allocator_(&allocator), memory_budget_(memory_budget), mip_uploads_per_frame_(mip_uploads_per_frame) {}
+
+void TextureStreamer::RequestTexture(GLuint texture, float pixels_per_texcoord) {
+  if (!allocator_->IsStreamed(texture)) {
+    return;
+  }
+
+  // One texel per pixel is enough, so every halving of the on-screen size allows one coarser level.
+  const float texels_per_pixel = static_cast<float>(allocator_->Width(texture)) / std::max(pixels_per_texcoord, 1e-6F);
+  const int desired_base_level =
+      std::clamp(static_cast<int>(std::floor(std::log2(std::max(texels_per_pixel, 1.0F)))),
+                 0,
+                 allocator_->MipLevelCount(texture) - 1);
+
+  auto [request, inserted] = requests_.try_emplace(texture, Request{desired_base_level, pixels_per_texcoord});
+  if (!inserted) {
+    request->second.desired_base_level = std::min(request->second.desired_base_level, desired_base_level);
+    request->second.pixels_per_texcoord = std::max(request->second.pixels_per_texcoord, pixels_per_texcoord);
+  }
+}
+
+int TextureStreamer::IdleBaseLevel(GLuint texture) const {
+  int level = 0;
+  while ((allocator_->Width(texture) >> level) > kIdleTextureSize && level + 1 < allocator_->MipLevelCount(texture)) {
+    level++;
+  }
+  return level;
+}
+
+void TextureStreamer::Update() {
+  // Forget the textures that were deallocated since the last update.
+  absl::erase_if(known_textures_, [this](GLuint texture) { return !allocator_->IsStreamed(texture); });
+  for (const auto &[texture, _] : requests_) {
+    known_textures_.insert(texture);
+  }
+
+  struct Entry {
+    GLuint texture;
+    int desired_base_level;
+    float priority;
+  };
+
+  std::vector<Entry> entries;
+  entries.reserve(known_textures_.size());
+  size_t total_bytes = 0;
+  for (const GLuint texture : known_textures_) {
+    const auto request = requests_.find(texture);
+    // Evicted textures stay evicted until something samples them again.
+    if (request == requests_.end() && allocator_->IsEvicted(texture)) {
+      continue;
+    }
+    const Entry entry = request == requests_.end()
+        ? Entry{texture, IdleBaseLevel(texture), 0.0F}
+        : Entry{texture, request->second.desired_base_level, request->second.pixels_per_texcoord};
+    total_bytes += allocator_->MipChainBytes(texture, entry.desired_base_level);
+    entries.push_back(entry);
+  }
+
+  // Over budget: coarsen the textures that are smallest on screen first. Every dropped level doubles the priority of
+  // the texture, so the cuts are spread over all distant textures instead of wiping out a single one.
+  auto lower_priority = [](const Entry *lhs, const Entry *rhs) { return lhs->priority > rhs->priority; };
+  std::priority_queue<Entry *, std::vector<Entry *>, decltype(lower_priority)> drop_candidates(lower_priority);
+  for (Entry &entry : entries) {
+    drop_candidates.push(&entry);
+  }
+  while (total_bytes > memory_budget_ && !drop_candidates.empty()) {
+    Entry *entry = drop_candidates.top();
+    drop_candidates.pop();
+    if (entry->desired_base_level + 1 >= allocator_->MipLevelCount(entry->texture)) {
+      continue;
+    }
+    total_bytes -= allocator_->MipChainBytes(entry->texture, entry->desired_base_level) -
+        allocator_->MipChainBytes(entry->texture, entry->desired_base_level + 1);
+    entry->desired_base_level++;
+    entry->priority *= 2.0F;
+    drop_candidates.push(entry);
+  }
+
+  // Dropping levels only releases memory, so it happens right away. Uploads are rationed per frame, one level at a time,
+  // starting with the textures that are the largest on screen.
+  std::vector<Entry *> pending_uploads;
+  for (Entry &entry : entries) {
+    const int resident_base_level = allocator_->ResidentBaseLevel(entry.texture);
+    if (entry.desired_base_level > resident_base_level) {
+      allocator_->SetResidentBaseLevel(entry.texture, entry.desired_base_level);
+    }
+    else if (entry.desired_base_level < resident_base_level) {
+      pending_uploads.push_back(&entry);
+    }
+  }
+  std::ranges::sort(pending_uploads, [](const Entry *lhs, const Entry *rhs) { return lhs->priority > rhs->priority; });
+  const size_t upload_count = std::min(pending_uploads.size(), static_cast<size_t>(mip_uploads_per_frame_));
+  for (size_t i = 0; i < upload_count; ++i) {
+    const GLuint texture = pending_uploads[i]->texture;
+    allocator_->SetResidentBaseLevel(texture, allocator_->ResidentBaseLevel(texture) - 1);
+  }
+
+  requests_.clear();
+}
+
+}  // namespace chove::rendering::opengl
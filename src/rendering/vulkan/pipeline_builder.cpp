@@ -2,7 +2,7 @@
 
 namespace chove::rendering::vulkan {
 
-PipelineBuilder::PipelineBuilder(const vk::Device device) : device_(device) {
+PipelineBuilder::PipelineBuilder(const vk::Device device, PipelineCache *cache) : device_(device), cache_(cache) {
   pipeline_rasterization_state_ = vk::PipelineRasterizationStateCreateInfo{
       vk::PipelineRasterizationStateCreateFlags{},
       false,
@@ -96,38 +96,94 @@ std::pair<vk::Pipeline, vk::PipelineLayout> PipelineBuilder::build(
         push_constant_ranges.end(), shader->push_constant_ranges().begin(), shader->push_constant_ranges().end()
     );
   }
-  vk::PipelineLayout layout = device_.createPipelineLayout(
-      vk::PipelineLayoutCreateInfo{vk::PipelineLayoutCreateFlags{}, descriptor_set_layouts, push_constant_ranges}
-  );
+  const auto create_layout = [&] {
+    return device_.createPipelineLayout(
+        vk::PipelineLayoutCreateInfo{vk::PipelineLayoutCreateFlags{}, descriptor_set_layouts, push_constant_ranges}
+    );
+  };
+  PipelineLayoutKey layout_key = LayoutKey();
+  vk::PipelineLayout layout =
+      cache_ != nullptr ? cache_->GetOrCreateLayout(layout_key, create_layout) : create_layout();
+
+  const auto create_pipeline = [&] {
+    vk::ResultValue<vk::Pipeline> result = device_.createGraphicsPipeline(
+        cache_ != nullptr ? cache_->cache() : vk::PipelineCache{},
+        vk::GraphicsPipelineCreateInfo{
+            flags,
+            shader_stages_,
+            &vertex_input_state_create_info,
+            &input_assembly_state_create_info_,
+            &tessellation_state_create_info_,
+            &viewport_state_create_info,
+            &pipeline_rasterization_state_,
+            &pipeline_multisample_state_,
+            &pipeline_depth_stencil_state_,
+            &pipeline_color_blend_state,
+            &dynamic_state_create_info,
+            layout,
+            render_pass,
+            subpass,
+            nullptr,
+            0,
+            nullptr
+        }
+    );
 
-  vk::ResultValue<vk::Pipeline> result = device_.createGraphicsPipeline(
-      nullptr,
-      vk::GraphicsPipelineCreateInfo{
-          flags,
-          shader_stages_,
-          &vertex_input_state_create_info,
-          &input_assembly_state_create_info_,
-          &tessellation_state_create_info_,
-          &viewport_state_create_info,
-          &pipeline_rasterization_state_,
-          &pipeline_multisample_state_,
-          &pipeline_depth_stencil_state_,
-          &pipeline_color_blend_state,
-          &dynamic_state_create_info,
-          layout,
-          render_pass,
-          subpass,
-          nullptr,  // TODO: Try to use pipeline derivatives
-          0,
-          nullptr
-      }
-  );
+    if (result.result != vk::Result::eSuccess) {
+      throw std::runtime_error("Failed to create pipeline.");
+    }
+    return result.value;
+  };
+  if (cache_ == nullptr) {
+    return {create_pipeline(), layout};
+  }
+  const PipelineKey pipeline_key = MakePipelineKey(std::move(layout_key), render_pass, subpass, flags);
+  return {cache_->GetOrCreatePipeline(pipeline_key, create_pipeline), layout};
+}
 
-  if (result.result != vk::Result::eSuccess) {
-    throw std::runtime_error("Failed to create pipeline.");
+std::future<std::pair<vk::Pipeline, vk::PipelineLayout>> PipelineBuilder::BuildAsync(
+    const vk::RenderPass render_pass, const uint32_t subpass, const vk::PipelineCreateFlags flags
+) const {
+  return std::async(std::launch::async, [builder = *this, render_pass, subpass, flags]() mutable {
+    return builder.build(render_pass, subpass, flags);
+  });
+}
+
+PipelineLayoutKey PipelineBuilder::LayoutKey() const {
+  PipelineLayoutKey key;
+  for (const auto &shader : shaders_) {
+    key.shaders.push_back({
+        shader->descriptor_set_layouts().size(),
+        shader->descriptor_set_layout_bindings(),
+        shader->push_constant_ranges()
+    });
   }
+  return key;
+}
 
-  return {result.value, layout};
+PipelineKey PipelineBuilder::MakePipelineKey(
+    PipelineLayoutKey layout_key, const vk::RenderPass render_pass, const uint32_t subpass,
+    const vk::PipelineCreateFlags flags
+) const {
+  PipelineKey key{
+      std::move(layout_key),
+      {},
+      vertex_input_binding_descriptions_,
+      vertex_input_attribute_descriptions_,
+      input_assembly_state_create_info_,
+      tessellation_state_create_info_,
+      pipeline_rasterization_state_,
+      pipeline_color_attachment_blend_state_,
+      pipeline_multisample_state_,
+      pipeline_depth_stencil_state_,
+      static_cast<VkRenderPass>(render_pass),
+      subpass,
+      static_cast<VkPipelineCreateFlags>(flags)
+  };
+  for (size_t i = 0; i < shaders_.size(); ++i) {
+    key.stages.emplace_back(static_cast<VkShaderStageFlags>(shader_stages_[i].stage), shaders_[i]->code());
+  }
+  return key;
 }
 
 PipelineBuilder &PipelineBuilder::AddInputBufferDescription(
@@ -0,0 +1,125 @@
+#include "rendering/vulkan/pipeline_cache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <absl/log/log.h>
+
+namespace chove::rendering::vulkan {
+
+namespace {
+
+// Drivers are not required to survive data written by another device or driver version, so the header is checked
+// before the data is handed over.
+bool IsCompatible(const std::vector<char> &data, const vk::PhysicalDeviceProperties &properties) {
+  VkPipelineCacheHeaderVersionOne header{};
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+         std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+std::vector<char> LoadCacheData(const std::filesystem::path &path, const vk::PhysicalDeviceProperties &properties) {
+  if (path.empty()) {
+    return {};
+  }
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    return {};
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  if (!IsCompatible(data, properties)) {
+    LOG(INFO) << "Pipeline cache " << path << " was written by another device or driver, starting empty";
+    return {};
+  }
+  LOG(INFO) << "Loaded pipeline cache " << path << " (" << data.size() << " bytes)";
+  return data;
+}
+
+}  // namespace
+
+PipelineCache::PipelineCache(const vk::Device device, const vk::PhysicalDevice physical_device,
+                             std::filesystem::path path)
+    : device_(device), device_properties_(physical_device.getProperties()), path_(std::move(path)) {
+  const std::vector<char> data = LoadCacheData(path_, device_properties_);
+  cache_ = device_.createPipelineCache(
+      vk::PipelineCacheCreateInfo{vk::PipelineCacheCreateFlags{}, data.size(), data.data()}
+  );
+}
+
+PipelineCache::~PipelineCache() {
+  Save();
+  for (auto &[key, pipeline] : pipelines_) {
+    device_.destroyPipeline(pipeline.get());
+  }
+  for (auto &[key, layout] : layouts_) {
+    device_.destroyPipelineLayout(layout.get());
+  }
+  device_.destroyPipelineCache(cache_);
+}
+
+vk::PipelineLayout PipelineCache::GetOrCreateLayout(const PipelineLayoutKey &key,
+                                                    const std::function<vk::PipelineLayout()> &create) {
+  return GetOrCreate(layouts_, key, create);
+}
+
+vk::Pipeline PipelineCache::GetOrCreatePipeline(const PipelineKey &key, const std::function<vk::Pipeline()> &create) {
+  return GetOrCreate(pipelines_, key, create);
+}
+
+template <typename Key, typename T>
+T PipelineCache::GetOrCreate(absl::flat_hash_map<Key, std::shared_future<T>> &objects, const Key &key,
+                             const std::function<T()> &create) {
+  std::promise<T> promise;
+  std::unique_lock lock(mutex_);
+  if (const auto existing = objects.find(key); existing != objects.end()) {
+    const std::shared_future<T> future = existing->second;
+    lock.unlock();
+    return future.get();
+  }
+  objects.emplace(key, promise.get_future().share());
+  lock.unlock();
+
+  try {
+    T object = create();
+    promise.set_value(object);
+    return object;
+  } catch (...) {
+    // Forget the failed entry so that a later request can try again, waiting requests get the same error.
+    promise.set_exception(std::current_exception());
+    lock.lock();
+    objects.erase(key);
+    throw;
+  }
+}
+
+void PipelineCache::Save() const {
+  if (path_.empty()) {
+    return;
+  }
+  const std::vector<uint8_t> data = device_.getPipelineCacheData(cache_);
+  std::filesystem::path temporary_path = path_;
+  temporary_path += ".tmp";
+  {
+    std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!output) {
+      LOG(WARNING) << "Failed to write pipeline cache " << path_;
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary_path, path_, error);
+  if (error) {
+    LOG(WARNING) << "Failed to replace pipeline cache " << path_ << ": " << error.message();
+  }
+}
+
+}  // namespace chove::rendering::vulkan
@@ -6,13 +6,18 @@ namespace chove::rendering::vulkan {
 
 namespace {
 
-vk::ShaderModule CreateShaderModule(const std::filesystem::path &shader_file_path, const vk::Device &device) {
+std::vector<char> ReadShaderCode(const std::filesystem::path &shader_file_path) {
   std::ifstream shader_file{shader_file_path, std::ios::binary};
   shader_file.seekg(0, std::ios::end);
   auto shader_file_size = shader_file.tellg();
   shader_file.seekg(0, std::ios::beg);
   std::vector<char> buffer(shader_file_size);
   shader_file.read(buffer.data(), shader_file_size);
+  return buffer;
+}
+
+vk::ShaderModule CreateShaderModule(std::vector<char> &buffer, const vk::Device &device) {
+  const size_t shader_file_size = buffer.size();
   std::span<uint32_t> shader_code{reinterpret_cast<uint32_t *>(buffer.data()), // NOLINT(*-pro-type-reinterpret-cast)
                                   static_cast<size_t>(shader_file_size / sizeof(uint32_t))};
 
@@ -24,8 +29,9 @@ vk::ShaderModule CreateShaderModule(const std::filesystem::path &shader_file_pat
 
 } // namespace
 
-Shader::Shader(const std::filesystem::path &path, vk::Device device)
-    : shader_(CreateShaderModule(path, device)), device_(device) {
+Shader::Shader(const std::filesystem::path &path, vk::Device device) : device_(device) {
+  code_ = ReadShaderCode(path);
+  shader_ = CreateShaderModule(code_, device);
 }
 
 void Shader::AddPushConstantRanges(const std::vector<vk::PushConstantRange> &ranges) {
@@ -52,6 +58,7 @@ Shader &Shader::operator=(Shader &&other) noexcept {
 
   other.shader_ = VK_NULL_HANDLE;
   other.device_ = VK_NULL_HANDLE;
+  code_ = std::move(other.code_);
 
   descriptor_set_layouts_ = std::move(other.descriptor_set_layouts_);
   descriptor_set_layout_bindings_ = std::move(other.descriptor_set_layout_bindings_);
@@ -1,5 +1,6 @@
 #include "rendering/vulkan/vulkan_renderer.h"
 
+#include "rendering/frustum_culler.h"
 #include "rendering/mesh.h"
 #include "rendering/vulkan/allocator.h"
 #include "rendering/vulkan/pipeline_builder.h"
@@ -8,11 +9,15 @@
 #include "windowing/events.h"
 #include "windowing/window.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <filesystem>
+#include <future>
+#include <memory>
 #include <utility>
 #include <vector>
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/log/log.h>
 #include <vulkan/vulkan.hpp>
 
@@ -26,6 +31,7 @@ namespace {
 constexpr auto kColorFormat = vk::Format::eB8G8R8A8Unorm;
 constexpr auto kColorSpace = vk::ColorSpaceKHR::eSrgbNonlinear;
 constexpr auto kDepthFormat = vk::Format::eD24UnormS8Uint;
+constexpr auto kPipelineCachePath = "pipeline_cache.bin";
 
 vk::Instance CreateInstance() {
   std::vector<const char *> required_instance_extensions = windowing::Window::GetRequiredVulkanExtensions();
@@ -350,7 +356,6 @@ void VulkanRenderer::Render() {
 
 void VulkanRenderer::SetupScene(objects::Scene &scene) {
   Shader vertex_shader{"shaders/vulkan/vulkan_shader.vert.spv", context_.device};
-  vertex_shader.AddPushConstantRanges({vk::PushConstantRange{vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4)}});
   // vertex_shader.AddDescriptorSetLayout(
   //     {vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex}}
   // );
@@ -363,21 +368,31 @@ void VulkanRenderer::SetupScene(objects::Scene &scene) {
   const vk::VertexInputAttributeDescription normal_attribute_description{
       1, 0, vk::Format::eR32G32B32Sfloat, static_cast<uint32_t>(offsetof(Mesh::Vertex, normal))
   };
+  // The model view projection matrix of every instance, one attribute per column.
+  constexpr vk::VertexInputBindingDescription instance_binding_description{
+      1, sizeof(glm::mat4), vk::VertexInputRate::eInstance
+  };
+  std::vector<vk::VertexInputAttributeDescription> instance_attribute_descriptions;
+  for (uint32_t column = 0; column < 4; ++column) {
+    instance_attribute_descriptions.emplace_back(
+        2 + column, 1, vk::Format::eR32G32B32A32Sfloat, static_cast<uint32_t>(column * sizeof(glm::vec4))
+    );
+  }
   Shader fragment_shader{"shaders/vulkan/vulkan_shader.frag.spv", context_.device};
-  PipelineBuilder pipeline_builder{context_.device};
-  auto [pipeline, layout] =
+  PipelineBuilder pipeline_builder{context_.device, pipeline_cache_.get()};
+  // The pipeline is compiled while the vertex data is uploaded.
+  std::future<std::pair<vk::Pipeline, vk::PipelineLayout>> pipeline_future =
       pipeline_builder.SetVertexShader(vertex_shader)
           .SetFragmentShader(fragment_shader)
           .SetInputTopology(vk::PrimitiveTopology::eTriangleList)
           .AddInputBufferDescription(
               vertex_binding_description, {position_attribute_description, normal_attribute_description}
           )
+          .AddInputBufferDescription(instance_binding_description, instance_attribute_descriptions)
           .SetFillMode(vk::PolygonMode::eFill)
           .SetColorBlendEnable(false)
           .SetDepthTestEnable(true)
-          .build(render_pass_, 0);
-  pipelines_.push_back(pipeline);
-  pipeline_layouts_.push_back(layout);
+          .BuildAsync(render_pass_, 0);
 
   scene_ = &scene;
 
@@ -392,13 +407,25 @@ void VulkanRenderer::SetupScene(objects::Scene &scene) {
   //         .front()
   // );
 
+  VmaAllocationCreateInfo allocation_create_info{};
+  allocation_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+  allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  allocation_create_info.priority = 1.0F;
+
+  // Entities importing the same model share its meshes, which are uploaded once.
+  absl::flat_hash_map<const Mesh *, RenderInfo> mesh_buffers;
+  size_t object_count = 0;
   for (auto &&[entity, transform, mesh] : scene_->GetAllObjectsWith<Transform, Mesh *>().each()) {
-    VmaAllocationCreateInfo allocation_create_info{};
-    allocation_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-    allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
-    allocation_create_info.priority = 1.0F;
+    object_count++;
+    const auto [uploaded, inserted] = mesh_buffers.try_emplace(mesh);
+    if (!inserted) {
+      RenderInfo render_info = uploaded->second;
+      render_info.model = transform.GetMatrix();
+      scene_->AddComponent(entity, render_info);
+      continue;
+    }
 
-    RenderInfo render_info;
+    RenderInfo &render_info = uploaded->second;
     render_info.vertex_buffer = allocator_.AllocateBuffer(
         vk::BufferCreateInfo{
             vk::BufferCreateFlags{},
@@ -430,6 +457,29 @@ void VulkanRenderer::SetupScene(objects::Scene &scene) {
     scene_->AddComponent(entity, render_info);
   }
 
+  for (int frame = 0; frame < kMaxFramesInFlight; ++frame) {
+    if (instance_buffers_.at(frame)) {
+      context_.device.waitIdle();
+      allocator_.Deallocate(instance_buffers_.at(frame));
+    }
+    instance_buffers_.at(frame) = allocator_.AllocateBuffer(
+        vk::BufferCreateInfo{
+            vk::BufferCreateFlags{},
+            std::max<size_t>(object_count, 1) * sizeof(glm::mat4),
+            vk::BufferUsageFlagBits::eVertexBuffer,
+            vk::SharingMode::eExclusive,
+            graphics_queue_family_index_
+        },
+        allocation_create_info
+    );
+    instance_buffer_memory_.at(frame) = allocator_.GetMappedMemory(instance_buffers_.at(frame));
+  }
+
+  auto [pipeline, layout] = pipeline_future.get();
+  pipelines_.push_back(pipeline);
+  pipeline_layouts_.push_back(layout);
+  pipeline_cache_->Save();
+
   shaders_.push_back(std::move(vertex_shader));
   shaders_.push_back(std::move(fragment_shader));
 }
@@ -545,18 +595,38 @@ void VulkanRenderer::RenderLoop() {
 
       const glm::mat4 camera_matrix = scene_->camera().GetProjectionMatrix() * scene_->camera().GetViewMatrix();
 
-      for (const auto &&[_, mesh, render_info] : scene_->GetAllObjectsWith<Mesh *, RenderInfo>().each()) {
+      auto view = scene_->GetAllObjectsWith<Mesh *, RenderInfo>();
+      frustum_culler_.Clear();
+      culled_entities_.clear();
+      for (const auto &&[entity, mesh, render_info] : view.each()) {
+        frustum_culler_.Add(mesh->bounding_box.Transformed(render_info.model));
+        culled_entities_.push_back(entity);
+      }
+      frustum_culler_.Cull(Frustum::FromMatrix(camera_matrix), visible_objects_);
+      std::ranges::sort(visible_objects_, {}, [&](const uint32_t visible_object) {
+        return view.get<Mesh *>(culled_entities_[visible_object]);
+      });
+
+      auto *instances = static_cast<glm::mat4 *>(instance_buffer_memory_.at(current_frame_));
+      for (size_t i = 0; i < visible_objects_.size(); ++i) {
+        instances[i] = camera_matrix * view.get<RenderInfo>(culled_entities_[visible_objects_[i]]).model;
+      }
+
+      // Every run of visible objects of one mesh is one instanced draw.
+      for (size_t first = 0; first < visible_objects_.size();) {
+        const auto [mesh, render_info] = view.get<Mesh *, RenderInfo>(culled_entities_[visible_objects_[first]]);
+        size_t last = first + 1;
+        while (last < visible_objects_.size() && view.get<Mesh *>(culled_entities_[visible_objects_[last]]) == mesh) {
+          last++;
+        }
         draw_cmd.bindVertexBuffers(
-            0,
-            {render_info.vertex_buffer, render_info.vertex_buffer},
-            {offsetof(Mesh::Vertex, position), offsetof(Mesh::Vertex, normal)}
+            0, {render_info.vertex_buffer, instance_buffers_.at(current_frame_)}, {vk::DeviceSize{0}, vk::DeviceSize{0}}
         );
         draw_cmd.bindIndexBuffer(render_info.index_buffer, vk::DeviceSize{0}, vk::IndexType::eUint32);
-        const glm::mat4 model_view_projection = camera_matrix * render_info.model;
-        draw_cmd.pushConstants(
-            pipeline_layouts_.front(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4), &model_view_projection
+        draw_cmd.drawIndexed(
+            mesh->indices.size(), static_cast<uint32_t>(last - first), 0, 0, static_cast<uint32_t>(first)
         );
-        draw_cmd.drawIndexed(mesh->indices.size(), 1, 0, 0, 0);
+        first = last;
       }
 
       draw_cmd.endRenderPass();
@@ -630,7 +700,8 @@ VulkanRenderer::VulkanRenderer(
     render_attachments_(render_attachments),
     graphics_queue_family_index_(graphics_queue_family_index),
     graphics_command_pool_(graphics_command_pool),
-    render_pass_(render_pass) {
+    render_pass_(render_pass),
+    pipeline_cache_(std::make_unique<PipelineCache>(context_.device, physical_device, kPipelineCachePath)) {
   graphics_queue_ = context_.device.getQueue(graphics_queue_family_index, 0);
   for (int i = 0; i < kMaxFramesInFlight; ++i) {
     synchronization_info_.at(i) = SynchronizationInfo{
@@ -654,9 +725,7 @@ VulkanRenderer::~VulkanRenderer() {
 
   context_.device.waitIdle();
 
-  for (const auto &layout : pipeline_layouts_) {
-    context_.device.destroyPipelineLayout(layout);
-  }
+  pipeline_cache_.reset();
 
   for (const auto &[depth_attachment, color_attachment_view, depth_attachment_view, framebuffer] :
        render_attachments_) {
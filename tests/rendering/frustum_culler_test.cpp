@@ -0,0 +1,84 @@
+#include "rendering/frustum_culler.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+
+namespace chove::rendering {
+namespace {
+
+// One box at a time, in the same order of operations as the SIMD lanes so that boxes touching a plane round the same.
+bool BruteForceVisible(const Frustum &frustum, const Mesh::BoundingBox &box) {
+  const glm::vec3 center = box.center();
+  const glm::vec3 extents = (box.max - box.min) / 2.0F;
+  for (const glm::vec4 &plane : frustum.planes) {
+    const float distance = plane.x * center.x + plane.w + plane.y * center.y + plane.z * center.z;
+    const float radius = extents.x * std::abs(plane.x) + extents.y * std::abs(plane.y) + extents.z * std::abs(plane.z);
+    if (distance + radius < 0.0F) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<Mesh::BoundingBox> RandomBoxes(size_t count) {
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<float> position(-200.0F, 200.0F);
+  std::uniform_real_distribution<float> size(0.01F, 10.0F);
+  std::vector<Mesh::BoundingBox> boxes;
+  boxes.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    const glm::vec3 min(position(generator), position(generator), position(generator));
+    boxes.push_back({min, min + glm::vec3(size(generator), size(generator), size(generator))});
+  }
+  return boxes;
+}
+
+Frustum TestFrustum() {
+  return Frustum::FromMatrix(glm::perspective(glm::radians(60.0F), 16.0F / 9.0F, 0.1F, 150.0F));
+}
+
+TEST(FrustumCullerTest, MatchesBruteForceOnRandomBoxes) {
+  // Not a multiple of any lane count, so the last group of boxes is partially padding.
+  const std::vector<Mesh::BoundingBox> boxes = RandomBoxes(100'003);
+  const Frustum frustum = TestFrustum();
+  FrustumCuller culler;
+  for (const Mesh::BoundingBox &box : boxes) {
+    culler.Add(box);
+  }
+  ASSERT_EQ(culler.size(), boxes.size());
+
+  std::vector<uint32_t> visible;
+  culler.Cull(frustum, visible);
+
+  std::vector<uint32_t> expected;
+  for (size_t i = 0; i < boxes.size(); i++) {
+    if (BruteForceVisible(frustum, boxes[i])) {
+      expected.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  ASSERT_FALSE(expected.empty());
+  ASSERT_LT(expected.size(), boxes.size());
+  EXPECT_EQ(visible, expected);
+}
+
+TEST(FrustumCullerTest, ClearForgetsBoxes) {
+  FrustumCuller culler;
+  culler.Add({glm::vec3(-1.0F, -1.0F, -11.0F), glm::vec3(1.0F, 1.0F, -9.0F)});
+  culler.Clear();
+  EXPECT_EQ(culler.size(), 0);
+  culler.Add({glm::vec3(-1.0F, -1.0F, 9.0F), glm::vec3(1.0F, 1.0F, 11.0F)});
+  culler.Add({glm::vec3(-1.0F, -1.0F, -11.0F), glm::vec3(1.0F, 1.0F, -9.0F)});
+
+  std::vector<uint32_t> visible{42};
+  culler.Cull(TestFrustum(), visible);
+  EXPECT_EQ(visible, std::vector<uint32_t>{1});
+}
+
+}  // namespace
+}  // namespace chove::rendering
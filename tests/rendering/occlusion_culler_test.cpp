@@ -0,0 +1,100 @@
+#include "rendering/occlusion_culler.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+
+namespace chove::rendering {
+namespace {
+
+constexpr int kWidth = 256;
+constexpr int kHeight = 128;
+
+// The camera sits at the origin looking down -z.
+glm::mat4 ViewProjection() { return glm::perspective(glm::radians(60.0F), 2.0F, 0.1F, 100.0F); }
+
+// A square facing the camera at the given depth, centered on the view axis.
+OccluderProxy Square(float half_size, float z) {
+  return OccluderProxy{
+      {glm::vec3(-half_size, -half_size, z), glm::vec3(half_size, -half_size, z), glm::vec3(half_size, half_size, z),
+       glm::vec3(-half_size, half_size, z)},
+      {0, 1, 2, 0, 2, 3},
+  };
+}
+
+void Rasterize(OcclusionCuller &culler, const std::vector<OccluderProxy> &occluders) {
+  culler.Begin(ViewProjection());
+  for (const OccluderProxy &occluder : occluders) {
+    culler.AddOccluder(glm::mat4(1.0F), occluder.positions, occluder.indices);
+  }
+  culler.Rasterize();
+}
+
+TEST(OcclusionCullerTest, HidesBoxBehindFullScreenOccluder) {
+  OcclusionCuller culler(kWidth, kHeight, 1);
+  Rasterize(culler, {Square(100.0F, -10.0F)});
+  EXPECT_EQ(culler.triangle_count(), 2);
+  EXPECT_FALSE(culler.IsVisible({glm::vec3(-1.0F, -1.0F, -22.0F), glm::vec3(1.0F, 1.0F, -20.0F)}));
+}
+
+TEST(OcclusionCullerTest, KeepsBoxInFrontOfOccluder) {
+  OcclusionCuller culler(kWidth, kHeight, 1);
+  Rasterize(culler, {Square(100.0F, -10.0F)});
+  EXPECT_TRUE(culler.IsVisible({glm::vec3(-1.0F, -1.0F, -6.0F), glm::vec3(1.0F, 1.0F, -4.0F)}));
+}
+
+TEST(OcclusionCullerTest, KeepsBoxCrossingNearPlane) {
+  OcclusionCuller culler(kWidth, kHeight, 1);
+  Rasterize(culler, {Square(100.0F, -10.0F)});
+  EXPECT_TRUE(culler.IsVisible({glm::vec3(-1.0F, -1.0F, -1.0F), glm::vec3(1.0F, 1.0F, 1.0F)}));
+}
+
+TEST(OcclusionCullerTest, KeepsBoxPeekingPastSilhouette) {
+  OcclusionCuller culler(kWidth, kHeight, 1);
+  Rasterize(culler, {Square(5.0F, -10.0F)});
+  EXPECT_FALSE(culler.IsVisible({glm::vec3(-2.0F, -2.0F, -22.0F), glm::vec3(2.0F, 2.0F, -20.0F)}));
+  EXPECT_TRUE(culler.IsVisible({glm::vec3(4.0F, -2.0F, -22.0F), glm::vec3(14.0F, 2.0F, -20.0F)}));
+}
+
+TEST(OcclusionCullerTest, BandsGiveSameResultForAnyThreadCount) {
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<float> lateral(-30.0F, 30.0F);
+  std::uniform_real_distribution<float> depth(-60.0F, -2.0F);
+  std::uniform_real_distribution<float> size(0.5F, 8.0F);
+
+  // Triangles scattered over the screen, crossing the bands in every way.
+  OccluderProxy occluders;
+  for (uint32_t i = 0; i < 300; i++) {
+    const glm::vec3 corner(lateral(generator), lateral(generator), depth(generator));
+    occluders.positions.push_back(corner);
+    occluders.positions.push_back(corner + glm::vec3(size(generator), 0.0F, 0.0F));
+    occluders.positions.push_back(corner + glm::vec3(0.0F, size(generator), size(generator) - 4.0F));
+    occluders.indices.insert(occluders.indices.end(), {3 * i, 3 * i + 1, 3 * i + 2});
+  }
+  std::vector<Mesh::BoundingBox> boxes;
+  for (int i = 0; i < 10'000; i++) {
+    const glm::vec3 min(lateral(generator), lateral(generator), depth(generator));
+    boxes.push_back({min, min + glm::vec3(size(generator) / 4.0F)});
+  }
+
+  OcclusionCuller single_thread(kWidth, kHeight, 1);
+  Rasterize(single_thread, {occluders});
+  int hidden_count = 0;
+  for (const int thread_count : {2, 3, 4}) {
+    OcclusionCuller multiple_threads(kWidth, kHeight, thread_count);
+    Rasterize(multiple_threads, {occluders});
+    for (const Mesh::BoundingBox &box : boxes) {
+      const bool visible = single_thread.IsVisible(box);
+      ASSERT_EQ(multiple_threads.IsVisible(box), visible) << thread_count << " threads";
+      hidden_count += visible ? 0 : 1;
+    }
+  }
+  EXPECT_GT(hidden_count, 0);
+}
+
+}  // namespace
+}  // namespace chove::rendering